@@ -0,0 +1,133 @@
+// Corpus generation and measurement helpers shared by the benchmark
+// harness and the stress suite.
+#ifndef BENCH_COMMON_HPP
+#define BENCH_COMMON_HPP
+
+#include "../src/trie.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// ==================== CORPUS ====================
+/**
+ * Synthetic corpus: lengths 2-14 with a peak around 7, letters drawn by
+ * English letter frequency, so shared stems and fan-out look roughly like
+ * a real word list. Deterministic for a given seed.
+ */
+inline std::vector<std::string> syntheticWords(size_t count, uint32_t seed) {
+  static const double LETTER_FREQUENCY[26] = {
+      8.2, 1.5, 2.8, 4.3, 12.7, 2.2, 2.0, 6.1, 7.0, 0.2, 0.8, 4.0, 2.4,
+      6.7, 7.5, 1.9, 0.1, 6.0, 6.3, 9.1, 2.8, 1.0, 2.4, 0.2, 2.0, 0.1};
+  std::mt19937 rng(seed);
+  std::discrete_distribution<int> letter(std::begin(LETTER_FREQUENCY),
+                                         std::end(LETTER_FREQUENCY));
+  std::binomial_distribution<int> length(12, 0.42);
+  std::vector<std::string> words(count);
+  for (std::string &word : words) {
+    word.resize(2 + length(rng));
+    for (char &ch : word)
+      ch = static_cast<char>('a' + letter(rng));
+  }
+  return words;
+}
+
+/**
+ * Real corpus in the --dict format; weights are dropped
+ */
+inline bool readWords(const std::string &filePath,
+                      std::vector<std::string> &words) {
+  std::ifstream in(filePath);
+  if (!in)
+    return false;
+  for (std::string line; std::getline(in, line);) {
+    autosuggest::splitWeight(line);
+    words.push_back(std::move(line));
+  }
+  return true;
+}
+
+// ==================== MEASUREMENT ====================
+struct Latency {
+  double p50;
+  double p99;
+  double p999;
+  double perSecond;
+};
+
+/**
+ * Percentiles of per-call latencies in nanoseconds; perSecond is the
+ * throughput implied by the summed call time
+ */
+inline Latency summarize(std::vector<uint64_t> &samples) {
+  if (samples.empty())
+    return {0, 0, 0, 0};
+  std::sort(samples.begin(), samples.end());
+  auto at = [&](double quantile) {
+    size_t index = static_cast<size_t>(quantile * (samples.size() - 1));
+    return static_cast<double>(samples[index]);
+  };
+  double total = 0;
+  for (uint64_t sample : samples)
+    total += static_cast<double>(sample);
+  return {at(0.50), at(0.99), at(0.999), samples.size() * 1e9 / total};
+}
+
+template <typename Work> double secondsFor(Work &&work) {
+  auto start = std::chrono::steady_clock::now();
+  work();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+/**
+ * Queries of exactly length bytes, each the stem of a random corpus word
+ */
+inline std::vector<std::string>
+samplePrefixes(const std::vector<std::string> &words, size_t length,
+               size_t count, std::mt19937 &rng) {
+  std::vector<std::string> prefixes;
+  prefixes.reserve(count);
+  std::uniform_int_distribution<size_t> pick(0, words.size() - 1);
+  for (size_t attempts = 0; prefixes.size() < count && attempts < count * 20;
+       attempts++) {
+    const std::string &word = words[pick(rng)];
+    if (word.size() >= length)
+      prefixes.push_back(word.substr(0, length));
+  }
+  return prefixes;
+}
+
+inline void printLatency(std::ostream &out, const Latency &latency) {
+  out << "\"per_sec\": " << latency.perSecond
+      << ", \"p50_ns\": " << latency.p50 << ", \"p99_ns\": " << latency.p99
+      << ", \"p999_ns\": " << latency.p999;
+}
+
+/**
+ * Current and peak resident set size in KiB, read from /proc/self/status;
+ * both are 0 where that file does not exist
+ */
+struct Resident {
+  size_t currentKb;
+  size_t peakKb;
+};
+
+inline Resident residentMemory() {
+  Resident resident{0, 0};
+  std::ifstream status("/proc/self/status");
+  for (std::string line; std::getline(status, line);) {
+    if (line.compare(0, 6, "VmRSS:") == 0)
+      resident.currentKb = std::strtoull(line.c_str() + 6, nullptr, 10);
+    else if (line.compare(0, 6, "VmHWM:") == 0)
+      resident.peakKb = std::strtoull(line.c_str() + 6, nullptr, 10);
+  }
+  return resident;
+}
+
+#endif
@@ -0,0 +1,232 @@
+#include "bench_common.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace chrono;
+using namespace autosuggest;
+
+// ==================== MAIN FUNCTION ====================
+int main(int argc, char *argv[]) {
+  string dictPath;
+  size_t wordTarget = 1000000, queryCount = 100000, limit = 10;
+  size_t maxPrefix = 8;
+  size_t threads = max<size_t>(1, thread::hardware_concurrency());
+  uint32_t seed = 42;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    auto number = [&]() { return strtoull(argv[++i], nullptr, 10); };
+    if (arg == "--dict" && i + 1 < argc) {
+      dictPath = argv[++i];
+    } else if (arg == "--words" && i + 1 < argc) {
+      wordTarget = number();
+    } else if (arg == "--queries" && i + 1 < argc) {
+      queryCount = max<size_t>(1, number());
+    } else if (arg == "--limit" && i + 1 < argc) {
+      limit = number();
+    } else if (arg == "--max-prefix" && i + 1 < argc) {
+      maxPrefix = max<size_t>(1, number());
+    } else if (arg == "--threads" && i + 1 < argc) {
+      threads = max<size_t>(1, number());
+    } else if (arg == "--seed" && i + 1 < argc) {
+      seed = static_cast<uint32_t>(number());
+    } else {
+      cerr << "Usage: " << argv[0]
+           << " [--words N | --dict PATH] [--queries N] [--limit N]"
+              " [--max-prefix N] [--threads N] [--seed N]\n";
+      return 1;
+    }
+  }
+
+  vector<string> words;
+  if (dictPath.empty()) {
+    words = syntheticWords(wordTarget, seed);
+  } else if (!readWords(dictPath, words)) {
+    cerr << "Cannot open dictionary file \"" << dictPath << "\"\n";
+    return 1;
+  }
+  if (words.empty()) {
+    cerr << "Corpus is empty\n";
+    return 1;
+  }
+  size_t totalBytes = 0;
+  for (const string &word : words)
+    totalBytes += word.size();
+
+  // Build three ways: random-order inserts, one sorted streaming pass,
+  // and the sharded parallel build
+  mt19937 rng(seed);
+  vector<string> shuffled = words;
+  shuffle(shuffled.begin(), shuffled.end(), rng);
+  Trie trie;
+  double insertSeconds = secondsFor([&] {
+    for (const string &word : shuffled)
+      trie.insert(word);
+  });
+
+  vector<string> sorted = words;
+  sort(sorted.begin(), sorted.end());
+  string joined;
+  joined.reserve(totalBytes + sorted.size());
+  for (const string &word : sorted) {
+    joined += word;
+    joined += '\n';
+  }
+  double sortedSeconds;
+  {
+    Trie sortedTrie;
+    istringstream in(move(joined));
+    sortedSeconds = secondsFor([&] { sortedTrie.loadFromStream(in); });
+  }
+  double parallelSeconds;
+  {
+    Trie parallelTrie;
+    ThreadPool pool(threads);
+    parallelSeconds =
+        secondsFor([&] { parallelTrie.buildParallel(shuffled, pool); });
+  }
+  shuffled.clear();
+  shuffled.shrink_to_fit();
+
+  // Point lookups, per prefix-length suggestion pages, top-K, and a full
+  // ordered enumeration. checksum keeps the work observable.
+  uint64_t checksum = 0;
+  vector<string> probes(queryCount);
+  for (string &probe : probes)
+    probe = words[rng() % words.size()];
+  double containsSeconds = secondsFor([&] {
+    for (const string &probe : probes)
+      checksum += trie.contains(probe);
+  });
+  // Dense 26-slot nodes over the same keys, for the lookup comparison
+  FixedAlphabetTrie<LowercaseAlphabet> dense;
+  for (const string &word : words)
+    dense.insert(word);
+  double denseSeconds = secondsFor([&] {
+    for (const string &probe : probes)
+      checksum += dense.contains(probe);
+  });
+
+  ostringstream json;
+  json << fixed << setprecision(1);
+  json << "{\n  \"corpus\": {\"source\": \""
+       << (dictPath.empty() ? "synthetic" : "file")
+       << "\", \"words\": " << words.size()
+       << ", \"unique\": " << trie.getWordCount() << ", \"avg_length\": "
+       << static_cast<double>(totalBytes) / words.size() << "},\n";
+  json << "  \"build\": {\"insert_per_sec\": "
+       << words.size() / insertSeconds
+       << ", \"sorted_load_per_sec\": " << words.size() / sortedSeconds
+       << ", \"parallel_build_per_sec\": " << words.size() / parallelSeconds
+       << ", \"threads\": " << threads << "},\n";
+  // Read-only forms of the same dictionary, for the memory comparison
+  FrozenTrie frozen = trie.freeze();
+  Dawg dawg(trie);
+  json << "  \"memory\": {\"nodes\": " << trie.getNodeCount()
+       << ", \"bytes\": " << trie.getMemoryUsage() << ", \"bytes_per_word\": "
+       << static_cast<double>(trie.getMemoryUsage()) / trie.getWordCount()
+       << ", \"frozen_bytes\": " << frozen.getMemoryUsage()
+       << ", \"dawg_states\": " << dawg.getStateCount()
+       << ", \"dawg_bytes\": " << dawg.getMemoryUsage()
+       << ", \"fixed_bytes\": " << dense.getMemoryUsage() << "},\n";
+  json << "  \"contains\": {\"per_sec\": " << probes.size() / containsSeconds
+       << ", \"fixed_per_sec\": " << probes.size() / denseSeconds << "},\n";
+
+  const char *kinds[2] = {"suggestions", "topk"};
+  for (int kind = 0; kind < 2; kind++) {
+    json << "  \"" << kinds[kind] << "\": {\"limit\": " << limit
+         << ", \"by_prefix_length\": [\n";
+    for (size_t length = 1; length <= maxPrefix; length++) {
+      vector<string> prefixes = samplePrefixes(words, length, queryCount, rng);
+      vector<uint64_t> samples;
+      samples.reserve(prefixes.size());
+      size_t results = 0;
+      for (const string &prefix : prefixes) {
+        auto start = steady_clock::now();
+        size_t found = kind == 0 ? trie.getSuggestions(prefix, limit).size()
+                                 : trie.getTopK(prefix, limit).size();
+        samples.push_back(static_cast<uint64_t>(
+            duration_cast<nanoseconds>(steady_clock::now() - start).count()));
+        results += found;
+      }
+      checksum += results;
+      Latency latency = summarize(samples);
+      json << "    {\"length\": " << length
+           << ", \"queries\": " << prefixes.size() << ", \"avg_results\": "
+           << (prefixes.empty() ? 0.0
+                                : static_cast<double>(results) /
+                                      prefixes.size())
+           << ", ";
+      printLatency(json, latency);
+      json << "}" << (length < maxPrefix ? "," : "") << "\n";
+    }
+    json << "  ]},\n";
+  }
+
+  // Batch answers at 1, 2, 4, ... threads must equal per-prefix calls.
+  // The query list is unsorted, repeats prefixes and mixes case, so
+  // sorting, deduplication and normalization inside the batch all matter.
+  vector<string> batch;
+  for (size_t length = 1; length <= maxPrefix; length++) {
+    vector<string> sampled =
+        samplePrefixes(words, length, queryCount / maxPrefix + 1, rng);
+    batch.insert(batch.end(), sampled.begin(), sampled.end());
+  }
+  for (size_t i = 0, copies = batch.size() / 10; i < copies; i++) {
+    string copy = batch[rng() % batch.size()];
+    if (i % 2 == 0 && !copy.empty())
+      copy[0] = static_cast<char>(toupper(copy[0]));
+    batch.push_back(move(copy));
+  }
+  batch.push_back("");
+  shuffle(batch.begin(), batch.end(), rng);
+  vector<vector<string>> expected(batch.size());
+  double sequentialSeconds = secondsFor([&] {
+    for (size_t i = 0; i < batch.size(); i++)
+      expected[i] = trie.getSuggestions(batch[i], limit);
+  });
+  size_t batchMismatches = 0;
+  json << "  \"batch\": {\"queries\": " << batch.size()
+       << ", \"limit\": " << limit
+       << ", \"sequential_per_sec\": " << batch.size() / sequentialSeconds
+       << ", \"by_threads\": [\n";
+  for (size_t workers = 1;; workers = min(workers * 2, threads)) {
+    ThreadPool pool(workers);
+    vector<vector<string>> answers;
+    double batchSeconds = secondsFor([&] {
+      answers = trie.getSuggestionsBatch(batch, limit,
+                                         workers > 1 ? &pool : nullptr);
+    });
+    size_t mismatches = answers.size() != expected.size();
+    for (size_t i = 0; i < min(answers.size(), expected.size()); i++)
+      mismatches += answers[i] != expected[i];
+    batchMismatches += mismatches;
+    json << "    {\"threads\": " << workers
+         << ", \"per_sec\": " << batch.size() / batchSeconds
+         << ", \"mismatches\": " << mismatches << "}"
+         << (workers < threads ? "," : "") << "\n";
+    if (workers == threads)
+      break;
+  }
+  json << "  ]},\n";
+
+  size_t enumerated = 0;
+  double enumerateSeconds = secondsFor([&] {
+    trie.forEachSuggestion("", [&](const string &word) {
+      enumerated++;
+      checksum += word.size();
+      return true;
+    });
+  });
+  json << "  \"enumerate\": {\"words_per_sec\": "
+       << enumerated / enumerateSeconds << "},\n";
+  json << "  \"checksum\": " << checksum << "\n}\n";
+  cout << json.str();
+  if (batchMismatches > 0) {
+    cerr << batchMismatches << " batch answer(s) differ from getSuggestions\n";
+    return 2;
+  }
+  return 0;
+}
@@ -0,0 +1,468 @@
+#include "bench_common.hpp"
+
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <sstream>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+using namespace std;
+using namespace chrono;
+using namespace autosuggest;
+
+// ==================== CHECKS ====================
+/**
+ * A suggestion page must be strictly increasing and every entry must start
+ * with prefix, however writers interleave with the read
+ */
+bool validPage(const vector<string> &page, const string &prefix) {
+  for (size_t i = 0; i < page.size(); i++) {
+    if (page[i].compare(0, prefix.size(), prefix) != 0)
+      return false;
+    if (i > 0 && !(page[i - 1] < page[i]))
+      return false;
+  }
+  return true;
+}
+
+/**
+ * Top-K results must share prefix and be ordered by weight, ties
+ * alphabetically
+ */
+bool validRanking(const vector<Suggestion> &top, const string &prefix) {
+  for (size_t i = 0; i < top.size(); i++) {
+    if (top[i].word.compare(0, prefix.size(), prefix) != 0)
+      return false;
+    if (i > 0 && (top[i - 1].weight < top[i].weight ||
+                  (top[i - 1].weight == top[i].weight &&
+                   !(top[i - 1].word < top[i].word))))
+      return false;
+  }
+  return true;
+}
+
+/** Hand freed heap pages back so RSS deltas reflect live data */
+void releaseFreeMemory() {
+#ifdef __GLIBC__
+  malloc_trim(0);
+#endif
+}
+
+// ==================== MIXED WORKLOAD ====================
+struct WorkloadConfig {
+  double seconds;
+  unsigned writePercent;
+  size_t limit;
+};
+
+/**
+ * Per-thread counters for one scaling level. Read latency is sampled on
+ * every 16th read to keep clock calls off the hot path.
+ */
+struct WorkerTally {
+  uint64_t reads = 0;
+  uint64_t writes = 0;
+  uint64_t violations = 0;
+  vector<uint64_t> readNanos;
+};
+
+/**
+ * One worker: until stop is raised, either write (an insert or a remove
+ * of a random corpus word, split evenly) or read (a suggestion page or a
+ * top-K list for a random prefix), validating every read
+ */
+void runWorker(ConcurrentTrie &trie, const vector<string> &words,
+               const vector<string> &prefixes, const WorkloadConfig &config,
+               uint32_t seed, const atomic<bool> &stop, WorkerTally &tally) {
+  mt19937 rng(seed);
+  uniform_int_distribution<unsigned> percent(0, 99);
+  while (!stop.load(memory_order_relaxed)) {
+    unsigned roll = percent(rng);
+    if (roll < config.writePercent) {
+      const string &word = words[rng() % words.size()];
+      if (roll % 2 == 0)
+        trie.insert(word, 1 + rng() % 1000);
+      else
+        trie.remove(word);
+      tally.writes++;
+      continue;
+    }
+    const string &prefix = prefixes[rng() % prefixes.size()];
+    bool sampled = (tally.reads++ & 15) == 0;
+    auto start = sampled ? steady_clock::now() : steady_clock::time_point();
+    bool valid = roll % 2 == 0
+                     ? validPage(trie.getSuggestions(prefix, config.limit),
+                                 prefix)
+                     : validRanking(trie.getTopK(prefix, config.limit),
+                                    prefix);
+    if (sampled)
+      tally.readNanos.push_back(static_cast<uint64_t>(
+          duration_cast<nanoseconds>(steady_clock::now() - start).count()));
+    tally.violations += !valid;
+  }
+}
+
+/**
+ * Thread counts 1, 2, 4, ... up to maxThreads, always ending on it
+ */
+vector<size_t> scalingLevels(size_t maxThreads) {
+  vector<size_t> levels;
+  for (size_t threads = 1; threads < maxThreads; threads *= 2)
+    levels.push_back(threads);
+  levels.push_back(maxThreads);
+  return levels;
+}
+
+// ==================== BACKENDS ====================
+/**
+ * std::set baseline with the engines' lookup calls. Memory is estimated
+ * as one tree node per word (three links and a color word) plus the
+ * string object and any heap buffer beyond its inline capacity.
+ */
+class SortedSetBackend {
+private:
+  set<string> words;
+
+public:
+  explicit SortedSetBackend(const vector<string> &keys)
+      : words(keys.begin(), keys.end()) {}
+
+  bool contains(const string &word) const { return words.count(word) != 0; }
+
+  vector<string> getSuggestions(const string &prefix, size_t limit) const {
+    vector<string> page;
+    for (auto it = words.lower_bound(prefix);
+         it != words.end() && page.size() < limit &&
+         it->compare(0, prefix.size(), prefix) == 0;
+         ++it)
+      page.push_back(*it);
+    return page;
+  }
+
+  size_t getMemoryUsage() const {
+    size_t bytes = words.size() * (4 * sizeof(void *) + sizeof(string));
+    for (const string &word : words)
+      if (word.capacity() > string().capacity())
+        bytes += word.capacity() + 1;
+    return bytes;
+  }
+};
+
+/**
+ * Answers one backend gives for the shared probe set. digest is an
+ * order-sensitive FNV-1a hash over every contains result and every word
+ * of every page, so two backends agree only if they return the same words
+ * in the same order, not merely the same counts.
+ */
+struct BackendAnswers {
+  size_t hits;
+  size_t suggestions;
+  uint64_t digest;
+};
+
+/** Fold bytes into an FNV-1a hash */
+void mixDigest(uint64_t &digest, const void *data, size_t size) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; i++) {
+    digest ^= bytes[i];
+    digest *= 1099511628211ULL;
+  }
+}
+
+/**
+ * Build a backend with build(), then time contains over probes and a
+ * suggestion page per prefix. RSS is sampled around the build with freed
+ * heap returned first, so the delta is what the structure keeps resident.
+ */
+template <typename Build>
+BackendAnswers measureBackend(ostream &json, const char *name, Build &&build,
+                              const vector<string> &probes,
+                              const vector<string> &prefixes, size_t limit) {
+  releaseFreeMemory();
+  Resident before = residentMemory();
+  auto start = steady_clock::now();
+  auto backend = build();
+  double buildMillis =
+      duration<double, milli>(steady_clock::now() - start).count();
+  releaseFreeMemory();
+  Resident after = residentMemory();
+
+  BackendAnswers answers{0, 0, 14695981039346656037ULL};
+  double containsSeconds = secondsFor([&] {
+    for (const string &probe : probes)
+      answers.hits += backend.contains(probe);
+  });
+  double suggestSeconds = secondsFor([&] {
+    for (const string &prefix : prefixes)
+      answers.suggestions += backend.getSuggestions(prefix, limit).size();
+  });
+  // Untimed pass for the digest, so hashing does not skew throughput
+  for (const string &probe : probes) {
+    bool hit = backend.contains(probe);
+    mixDigest(answers.digest, &hit, sizeof(hit));
+  }
+  for (const string &prefix : prefixes) {
+    for (const string &word : backend.getSuggestions(prefix, limit))
+      mixDigest(answers.digest, word.c_str(), word.size() + 1);
+    mixDigest(answers.digest, "\n", 1);
+  }
+  json << "    {\"backend\": \"" << name
+       << "\", \"build_ms\": " << buildMillis
+       << ", \"bytes\": " << backend.getMemoryUsage() << ", \"rss_delta_kb\": "
+       << (after.currentKb > before.currentKb
+               ? after.currentKb - before.currentKb
+               : 0)
+       << ", \"contains_per_sec\": " << probes.size() / containsSeconds
+       << ", \"suggest_per_sec\": " << prefixes.size() / suggestSeconds << "}";
+  return answers;
+}
+
+// ==================== MAIN FUNCTION ====================
+int main(int argc, char *argv[]) {
+  string dictPath;
+  size_t wordTarget = 200000, maxThreads = 64, limit = 10;
+  size_t churnCycles = 20, queryCount = 50000;
+  double seconds = 1.0;
+  unsigned writePercent = 10;
+  uint32_t seed = 42;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    auto number = [&]() { return strtoull(argv[++i], nullptr, 10); };
+    if (arg == "--dict" && i + 1 < argc) {
+      dictPath = argv[++i];
+    } else if (arg == "--words" && i + 1 < argc) {
+      wordTarget = number();
+    } else if (arg == "--max-threads" && i + 1 < argc) {
+      maxThreads = max<size_t>(1, number());
+    } else if (arg == "--seconds" && i + 1 < argc) {
+      seconds = max(0.01, strtod(argv[++i], nullptr));
+    } else if (arg == "--write-percent" && i + 1 < argc) {
+      writePercent = static_cast<unsigned>(min(100ULL, number()));
+    } else if (arg == "--limit" && i + 1 < argc) {
+      limit = max<size_t>(1, number());
+    } else if (arg == "--queries" && i + 1 < argc) {
+      queryCount = max<size_t>(1, number());
+    } else if (arg == "--churn-cycles" && i + 1 < argc) {
+      churnCycles = max<size_t>(1, number());
+    } else if (arg == "--seed" && i + 1 < argc) {
+      seed = static_cast<uint32_t>(number());
+    } else {
+      cerr << "Usage: " << argv[0]
+           << " [--words N | --dict PATH] [--max-threads N] [--seconds S]"
+              " [--write-percent P] [--limit N] [--queries N]"
+              " [--churn-cycles N] [--seed N]\n";
+      return 1;
+    }
+  }
+
+  vector<string> raw;
+  if (dictPath.empty()) {
+    raw = syntheticWords(wordTarget, seed);
+  } else if (!readWords(dictPath, raw)) {
+    cerr << "Cannot open dictionary file \"" << dictPath << "\"\n";
+    return 1;
+  }
+  // Every backend sees the same normalized, de-duplicated keys
+  KeyNormalizer keys = KeyNormalizer::letters();
+  vector<string> words;
+  words.reserve(raw.size());
+  for (const string &word : raw) {
+    string key = keys.normalize(word);
+    if (!key.empty())
+      words.push_back(move(key));
+  }
+  raw.clear();
+  raw.shrink_to_fit();
+  sort(words.begin(), words.end());
+  words.erase(unique(words.begin(), words.end()), words.end());
+  if (words.empty()) {
+    cerr << "Corpus is empty\n";
+    return 1;
+  }
+
+  mt19937 rng(seed);
+  vector<string> prefixes;
+  for (size_t length = 1; length <= 4; length++) {
+    vector<string> sampled =
+        samplePrefixes(words, length, queryCount / 4 + 1, rng);
+    prefixes.insert(prefixes.end(), sampled.begin(), sampled.end());
+  }
+  // Half hits, half (mostly) misses from a differently seeded corpus
+  vector<string> probes = syntheticWords(queryCount / 2, seed + 1);
+  for (size_t i = probes.size(); i < queryCount; i++)
+    probes.push_back(words[rng() % words.size()]);
+  shuffle(probes.begin(), probes.end(), rng);
+
+  uint64_t violations = 0;
+  ostringstream json;
+  json << fixed << setprecision(1);
+  json << "{\n  \"corpus\": {\"source\": \""
+       << (dictPath.empty() ? "synthetic" : "file")
+       << "\", \"unique\": " << words.size() << ", \"rss_kb\": "
+       << residentMemory().currentKb << "},\n";
+
+  // Scaling: a fresh ConcurrentTrie per level, preloaded with the corpus,
+  // then every thread runs the same mixed workload for a fixed time
+  WorkloadConfig config{seconds, writePercent, limit};
+  json << "  \"scaling\": {\"hardware_threads\": "
+       << thread::hardware_concurrency()
+       << ", \"write_percent\": " << writePercent
+       << ", \"seconds\": " << seconds << ", \"levels\": [\n";
+  double baseline = 0;
+  vector<size_t> levels = scalingLevels(maxThreads);
+  for (size_t level = 0; level < levels.size(); level++) {
+    size_t threads = levels[level];
+    ConcurrentTrie trie;
+    for (const string &word : words)
+      trie.insert(word, 1 + rng() % 1000);
+    trie.publish();
+
+    vector<WorkerTally> tallies(threads);
+    vector<thread> workers;
+    atomic<bool> stop{false};
+    for (size_t t = 0; t < threads; t++)
+      workers.emplace_back(runWorker, ref(trie), cref(words), cref(prefixes),
+                           cref(config), seed + static_cast<uint32_t>(t),
+                           cref(stop), ref(tallies[t]));
+    this_thread::sleep_for(duration<double>(seconds));
+    stop = true;
+    for (thread &worker : workers)
+      worker.join();
+
+    // Once quiet, the published count must match what enumeration sees
+    trie.publish();
+    uint64_t levelViolations =
+        static_cast<size_t>(trie.getWordCount()) !=
+        trie.getSuggestions("").size();
+    uint64_t reads = 0, writes = 0;
+    vector<uint64_t> samples;
+    for (WorkerTally &tally : tallies) {
+      reads += tally.reads;
+      writes += tally.writes;
+      levelViolations += tally.violations;
+      samples.insert(samples.end(), tally.readNanos.begin(),
+                     tally.readNanos.end());
+    }
+    violations += levelViolations;
+    Latency latency = summarize(samples);
+    double opsPerSecond = (reads + writes) / seconds;
+    if (level == 0)
+      baseline = opsPerSecond;
+    json << "    {\"threads\": " << threads
+         << ", \"ops_per_sec\": " << opsPerSecond
+         << ", \"reads_per_sec\": " << reads / seconds
+         << ", \"writes_per_sec\": " << writes / seconds << ", \"speedup\": "
+         << setprecision(2) << (baseline > 0 ? opsPerSecond / baseline : 0.0)
+         << setprecision(1) << ", \"read_p50_ns\": " << latency.p50
+         << ", \"read_p99_ns\": " << latency.p99
+         << ", \"read_p999_ns\": " << latency.p999
+         << ", \"violations\": " << levelViolations
+         << ", \"rss_kb\": " << residentMemory().currentKb << "}"
+         << (level + 1 < levels.size() ? "," : "") << "\n";
+  }
+  json << "  ]},\n";
+
+  // Churn: insert and remove the same batch repeatedly. Freed nodes go
+  // back to the pool, so the arena must stop growing after one cycle.
+  {
+    Trie trie;
+    for (const string &word : words)
+      trie.insert(word);
+    vector<string> batch = syntheticWords(words.size() / 4 + 1, seed + 2);
+    size_t firstCycleBytes = 0;
+    Resident before = residentMemory();
+    for (size_t cycle = 0; cycle < churnCycles; cycle++) {
+      for (const string &word : batch)
+        trie.insert(word);
+      for (const string &word : batch)
+        if (!binary_search(words.begin(), words.end(), keys.normalize(word)))
+          trie.remove(word);
+      if (cycle == 0)
+        firstCycleBytes = trie.getMemoryUsage();
+    }
+    size_t lastCycleBytes = trie.getMemoryUsage();
+    bool leaked = lastCycleBytes > firstCycleBytes ||
+                  static_cast<size_t>(trie.getWordCount()) != words.size();
+    violations += leaked;
+    json << "  \"churn\": {\"cycles\": " << churnCycles
+         << ", \"batch\": " << batch.size()
+         << ", \"bytes_after_first\": " << firstCycleBytes
+         << ", \"bytes_after_last\": " << lastCycleBytes
+         << ", \"rss_before_kb\": " << before.currentKb
+         << ", \"rss_after_kb\": " << residentMemory().currentKb
+         << ", \"violations\": " << leaked << "},\n";
+  }
+
+  // Backends side by side on the same keys; all must agree with std::set
+  json << "  \"backends\": [\n";
+  vector<BackendAnswers> answers;
+  answers.push_back(measureBackend(
+      json, "set", [&] { return SortedSetBackend(words); }, probes, prefixes,
+      limit));
+  json << ",\n";
+  answers.push_back(measureBackend(
+      json, "compact",
+      [&] {
+        Trie trie;
+        for (const string &word : words)
+          trie.insert(word);
+        return trie;
+      },
+      probes, prefixes, limit));
+  json << ",\n";
+  answers.push_back(measureBackend(
+      json, "radix",
+      [&] {
+        RadixTrie trie;
+        for (const string &word : words)
+          trie.insert(word);
+        return trie;
+      },
+      probes, prefixes, limit));
+  json << ",\n";
+  answers.push_back(measureBackend(
+      json, "succinct",
+      [&] {
+        Trie trie;
+        for (const string &word : words)
+          trie.insert(word);
+        return trie.freeze();
+      },
+      probes, prefixes, limit));
+  json << ",\n";
+  answers.push_back(measureBackend(
+      json, "dawg",
+      [&] {
+        Dawg dawg;
+        for (const string &word : words)
+          dawg.add(word);
+        dawg.finish();
+        return dawg;
+      },
+      probes, prefixes, limit));
+  json << ",\n";
+  answers.push_back(measureBackend(
+      json, "dense",
+      [&] {
+        FixedAlphabetTrie<LowercaseAlphabet> trie;
+        for (const string &word : words)
+          trie.insert(word);
+        return trie;
+      },
+      probes, prefixes, limit));
+  json << "\n  ],\n";
+  uint64_t disagreements = 0;
+  for (const BackendAnswers &answer : answers)
+    disagreements += answer.hits != answers[0].hits ||
+                     answer.suggestions != answers[0].suggestions ||
+                     answer.digest != answers[0].digest;
+  violations += disagreements;
+
+  json << "  \"backend_disagreements\": " << disagreements
+       << ",\n  \"peak_rss_kb\": " << residentMemory().peakKb
+       << ",\n  \"violations\": " << violations << "\n}\n";
+  cout << json.str();
+  return violations == 0 ? 0 : 2;
+}
@@ -0,0 +1,4679 @@
+// Trie engine: normalization, node storage, the Trie and its variants
+// (RadixTrie, MappedTrie, ConcurrentTrie, FrozenTrie, Dawg,
+// FixedAlphabetTrie, ShardedTrie), ranking, caching and snapshots.
+// Shared by the interactive program and the benchmark harness.
+#ifndef TRIE_HPP
+#define TRIE_HPP
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <istream>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+// Everything below is in namespace autosuggest, and the std directive is
+// scoped to it, so including this header declares nothing at global
+// scope. Programs opt in with their own using-directives.
+namespace autosuggest {
+using namespace std;
+
+// ==================== KEY NORMALIZATION ====================
+/**
+ * KeyNormalizer turns raw input into trie keys in one pass: every byte is
+ * looked up in a 256-entry table, where 0 means the byte is dropped, and
+ * whitespace around the mapped key is trimmed. Keys are plain byte
+ * strings, so UTF-8 text is stored as its encoded bytes and the node
+ * layout is unchanged. The same table normalizes queries, so lookups
+ * always agree with what was inserted.
+ * Time: O(L) per key, one table load per byte
+ */
+class KeyNormalizer {
+public:
+  using Table = array<unsigned char, 256>;
+
+private:
+  Table table;
+
+public:
+  explicit KeyNormalizer(const Table &mapping) : table(mapping) {}
+
+  /**
+   * ASCII letters only, lowercased - the original dictionary behaviour
+   */
+  static KeyNormalizer letters() {
+    Table mapping{};
+    for (int ch = 'a'; ch <= 'z'; ch++) {
+      mapping[ch] = static_cast<unsigned char>(ch);
+      mapping[ch - 'a' + 'A'] = static_cast<unsigned char>(ch);
+    }
+    return KeyNormalizer(mapping);
+  }
+
+  /**
+   * Every byte except ASCII control characters, with ASCII letters
+   * lowercased. Punctuation and digits stay significant ("e-mail" and
+   * "email" are distinct) and UTF-8 sequences pass through untouched.
+   */
+  static KeyNormalizer bytes() {
+    Table mapping{};
+    for (int ch = 0x20; ch < 256; ch++)
+      mapping[ch] = static_cast<unsigned char>(ch);
+    mapping[0x7F] = 0;
+    for (int ch = 'A'; ch <= 'Z'; ch++)
+      mapping[ch] = static_cast<unsigned char>(ch - 'A' + 'a');
+    return KeyNormalizer(mapping);
+  }
+
+  const Table &mapping() const { return table; }
+
+  /** Table value for one byte; 0 if the byte is dropped */
+  unsigned char map(char ch) const {
+    return table[static_cast<unsigned char>(ch)];
+  }
+
+  /** Whether byte is dropped or maps to whitespace */
+  bool blank(char byte) const {
+    unsigned char ch = map(byte);
+    return ch == 0 || ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+  }
+
+  /**
+   * Narrow raw to the span from the first to the last byte that maps to a
+   * non-whitespace key byte; no bytes are copied. Trimming by mapped value
+   * rather than raw byte keeps a dropped byte such as "\x01" in "tea \x01"
+   * from shielding the space before it, so normalizing a key again leaves
+   * it unchanged.
+   */
+  string_view trimmed(string_view raw) const {
+    size_t first = 0, last = raw.size();
+    while (first < last && blank(raw[first]))
+      first++;
+    while (last > first && blank(raw[last - 1]))
+      last--;
+    return raw.substr(first, last - first);
+  }
+
+  /**
+   * Normalize raw into out. out is reused by callers that normalize many
+   * words, so steady-state loads do not allocate.
+   */
+  void normalize(string_view raw, string &out) const {
+    out.clear();
+    for (char byte : trimmed(raw)) {
+      unsigned char ch = map(byte);
+      if (ch != 0)
+        out.push_back(static_cast<char>(ch));
+    }
+  }
+
+  string normalize(string_view raw) const {
+    string out;
+    normalize(raw, out);
+    return out;
+  }
+};
+
+// ==================== LABEL SEARCH ====================
+/** Index of the lowest set bit of a non-zero mask */
+inline size_t lowestSetBit(uint64_t mask) {
+  return bitset<64>((mask & (~mask + 1)) - 1).count();
+}
+
+/**
+ * Sorted sibling labels (MappedTrie, FrozenTrie, Dawg) are searched with a
+ * vector compare per 16 or 32 bytes: SSE2 or NEON where the target always
+ * has it, AVX2 when the CPU reports it at startup. A block whose last
+ * label is already past ch ends the scan. Ranges shorter than one vector,
+ * the common case below the top levels, take the scalar loop, which is
+ * also the fallback on other targets. All loads stay inside the range.
+ * Returns the position of ch, or count if absent.
+ * Time: O(F / W) where W = vector width
+ */
+inline size_t findLabelScalar(const unsigned char *labels, size_t begin,
+                              size_t count, unsigned char ch) {
+  for (size_t i = begin; i < count && labels[i] <= ch; i++) {
+    if (labels[i] == ch)
+      return i;
+  }
+  return count;
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+inline size_t findLabelVector(const unsigned char *labels, size_t count,
+                              unsigned char ch) {
+  __m128i needle = _mm_set1_epi8(static_cast<char>(ch));
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(labels + i));
+    unsigned mask =
+        static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+    if (mask)
+      return i + lowestSetBit(mask);
+    if (labels[i + 15] > ch)
+      return count;
+  }
+  return findLabelScalar(labels, i, count, ch);
+}
+#elif defined(__ARM_NEON)
+inline size_t findLabelVector(const unsigned char *labels, size_t count,
+                              unsigned char ch) {
+  uint8x16_t needle = vdupq_n_u8(ch);
+  size_t i = 0;
+  for (; i + 16 <= count; i += 16) {
+    uint8x16_t equal = vceqq_u8(vld1q_u8(labels + i), needle);
+    // Narrow each byte of the compare to 4 bits of one 64-bit mask
+    uint64_t mask = vget_lane_u64(
+        vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+    if (mask)
+      return i + lowestSetBit(mask) / 4;
+    if (labels[i + 15] > ch)
+      return count;
+  }
+  return findLabelScalar(labels, i, count, ch);
+}
+#else
+inline size_t findLabelVector(const unsigned char *labels, size_t count,
+                              unsigned char ch) {
+  return findLabelScalar(labels, 0, count, ch);
+}
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRIE_HAS_AVX2_SEARCH 1
+__attribute__((target("avx2"))) inline size_t
+findLabelAvx2(const unsigned char *labels, size_t count, unsigned char ch) {
+  __m256i needle = _mm256_set1_epi8(static_cast<char>(ch));
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(labels + i));
+    unsigned mask = static_cast<unsigned>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+    if (mask)
+      return i + lowestSetBit(mask);
+    if (labels[i + 31] > ch)
+      return count;
+  }
+  return i + findLabelVector(labels + i, count - i, ch);
+}
+#endif
+
+using LabelSearch = size_t (*)(const unsigned char *, size_t, unsigned char);
+
+/** Widest kernel this CPU supports, chosen on first use */
+inline LabelSearch selectLabelSearch() {
+#ifdef TRIE_HAS_AVX2_SEARCH
+  if (__builtin_cpu_supports("avx2"))
+    return findLabelAvx2;
+#endif
+  return findLabelVector;
+}
+
+inline size_t findLabel(const unsigned char *labels, size_t count,
+                        unsigned char ch) {
+  if (count < 16)
+    return findLabelScalar(labels, 0, count, ch);
+  static const LabelSearch search = selectLabelSearch();
+  return search(labels, count, ch);
+}
+
+/**
+ * Hint that addr will be read soon; used where a node is queued for later
+ * expansion rather than dereferenced straight away
+ */
+#if defined(__GNUC__)
+#define TRIE_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define TRIE_PREFETCH(addr) ((void)(addr))
+#endif
+
+// ==================== TRIE NODE STRUCTURE ====================
+/**
+ * TrieNode represents a single node in the Trie data structure.
+ * Low fan-out nodes keep up to INLINE_CHILDREN sorted labels inline; past
+ * that, slots[0] indexes a WideChildren bitmap table owned by the Trie.
+ * Children are referenced by 32-bit NodePool indices rather than pointers.
+ * maxWeight is the highest word weight anywhere in the node's subtree and
+ * bounds the best-first search in Trie::getTopK.
+ * Space Complexity: 32 bytes per node, plus WideChildren for fan-out > 4
+ */
+struct TrieNode {
+  static constexpr uint16_t INLINE_CHILDREN = 4;
+
+  uint16_t childCount;
+  bool isEndOfWord;
+  unsigned char labels[INLINE_CHILDREN];
+  uint32_t slots[INLINE_CHILDREN];
+  uint32_t weight;
+  uint32_t maxWeight;
+  TrieNode()
+      : childCount(0), isEndOfWord(false), labels(), slots(), weight(0),
+        maxWeight(0) {}
+
+  bool isWide() const { return childCount > INLINE_CHILDREN; }
+};
+
+// ==================== WIDE CHILDREN ====================
+/**
+ * WideChildren holds the children of a high fan-out node as a 256-bit label
+ * bitmap plus a dense index array ordered by label. A child's position is
+ * the popcount of the bitmap below its label.
+ * Lookup: O(1), Insert: O(fan-out)
+ */
+struct WideChildren {
+  uint64_t bitmap[4] = {0, 0, 0, 0};
+  vector<uint32_t> children;
+
+  bool contains(unsigned char ch) const {
+    return (bitmap[ch >> 6] >> (ch & 63)) & 1;
+  }
+
+  size_t rank(unsigned char ch) const {
+    size_t count = 0;
+    for (int w = 0; w < (ch >> 6); w++)
+      count += bitset<64>(bitmap[w]).count();
+    uint64_t below = (uint64_t(1) << (ch & 63)) - 1;
+    return count + bitset<64>(bitmap[ch >> 6] & below).count();
+  }
+
+  void add(unsigned char ch, uint32_t child) {
+    children.insert(children.begin() + rank(ch), child);
+    bitmap[ch >> 6] |= uint64_t(1) << (ch & 63);
+  }
+
+  void remove(unsigned char ch) {
+    children.erase(children.begin() + rank(ch));
+    bitmap[ch >> 6] &= ~(uint64_t(1) << (ch & 63));
+  }
+};
+
+// ==================== NODE POOL ====================
+/**
+ * NodePool is an arena that hands out nodes from fixed-size chunks.
+ * Nodes never move once allocated, so references stay valid while the pool
+ * grows, and teardown releases whole chunks instead of walking the trie.
+ * Released nodes go on a free list and are handed out again by allocate(),
+ * so insert/remove churn reuses slots instead of growing the pool.
+ * Allocate: O(1) amortized, Release: O(1), Clear: O(chunks)
+ */
+template <typename Node> class NodePool {
+private:
+  static constexpr uint32_t CHUNK_BITS = 12;
+  static constexpr uint32_t CHUNK_SIZE = 1u << CHUNK_BITS;
+  static constexpr uint32_t CHUNK_MASK = CHUNK_SIZE - 1;
+
+  vector<unique_ptr<Node[]>> chunks;
+  vector<uint32_t> freeList;
+  uint32_t used;
+
+public:
+  NodePool() : used(0) {}
+
+  uint32_t allocate() {
+    if (!freeList.empty()) {
+      uint32_t index = freeList.back();
+      freeList.pop_back();
+      return index;
+    }
+    if (used == numeric_limits<uint32_t>::max())
+      throw length_error("NodePool: 32-bit node index space exhausted");
+    if ((used >> CHUNK_BITS) == chunks.size())
+      chunks.push_back(make_unique<Node[]>(CHUNK_SIZE));
+    return used++;
+  }
+
+  /**
+   * Reserve count consecutive indices and return the first; every chunk
+   * they touch is allocated up front, so the range can then be filled
+   * from several threads without further pool mutation.
+   */
+  uint32_t allocateRange(uint32_t count) {
+    if (count > numeric_limits<uint32_t>::max() - used)
+      throw length_error("NodePool: 32-bit node index space exhausted");
+    uint32_t first = used;
+    used += count;
+    while ((uint64_t(chunks.size()) << CHUNK_BITS) < used)
+      chunks.push_back(make_unique<Node[]>(CHUNK_SIZE));
+    return first;
+  }
+
+  Node &operator[](uint32_t index) {
+    return chunks[index >> CHUNK_BITS][index & CHUNK_MASK];
+  }
+  const Node &operator[](uint32_t index) const {
+    return chunks[index >> CHUNK_BITS][index & CHUNK_MASK];
+  }
+
+  /**
+   * Return a node to the pool; it is reset now so allocate() can hand it
+   * out again as a fresh node
+   */
+  void release(uint32_t index) {
+    (*this)[index] = Node();
+    freeList.push_back(index);
+  }
+
+  void clear() {
+    chunks.clear();
+    freeList.clear();
+    used = 0;
+  }
+
+  /** Indices handed out so far, live or released (the high-water mark) */
+  uint32_t size() const { return used; }
+  uint32_t liveCount() const {
+    return used - static_cast<uint32_t>(freeList.size());
+  }
+  size_t chunkCount() const { return chunks.size(); }
+
+  /** Bytes held by the arena: whole chunks plus bookkeeping */
+  size_t memoryUsage() const {
+    return chunks.size() * CHUNK_SIZE * sizeof(Node) +
+           chunks.capacity() * sizeof(unique_ptr<Node[]>) +
+           freeList.capacity() * sizeof(uint32_t);
+  }
+};
+
+// ==================== SUGGESTION ====================
+/**
+ * Suggestion pairs a word with its ranking weight (frequency/score).
+ */
+struct Suggestion {
+  string word;
+  uint32_t weight;
+};
+
+/**
+ * Split a dictionary line of the form "word" or "word<TAB>weight": strips
+ * the weight field from line and returns it. A field that is not a
+ * non-negative decimal integer (surrounding whitespace aside), such as
+ * "-5" or "abc", gives the default weight 1, as does a missing field; one
+ * above UINT32_MAX is clamped to it.
+ */
+inline uint32_t splitWeight(string &line) {
+  size_t tab = line.find('\t');
+  if (tab == string::npos)
+    return 1;
+  const char *digits = line.c_str() + tab + 1;
+  digits += strspn(digits, " \t\n\r");
+  char *end = nullptr;
+  errno = 0;
+  unsigned long long value =
+      *digits >= '0' && *digits <= '9' ? strtoull(digits, &end, 10) : 0;
+  bool valid = end != nullptr && end[strspn(end, " \t\n\r")] == '\0';
+  bool overflow = errno == ERANGE || value > numeric_limits<uint32_t>::max();
+  line.resize(tab);
+  if (!valid)
+    return 1;
+  return overflow ? numeric_limits<uint32_t>::max()
+                  : static_cast<uint32_t>(value);
+}
+
+/**
+ * LoadStats summarises a bulk load: lines read, new words added, whether
+ * the normalized keys arrived in sorted order, and of the key bytes, how
+ * many were resumed from the previous key's node path instead of
+ * descended. The share is highest for sorted input.
+ */
+struct LoadStats {
+  size_t lines;
+  size_t added;
+  bool sorted;
+  size_t keyBytes;
+  size_t resumedBytes;
+};
+
+// ==================== RANKING ====================
+/**
+ * Best-first top-k search shared by every trie engine. expand(node,
+ * pushWord, pushChild) reports a node's own word weight (if it ends a word)
+ * and each child with its subtree-max bound. Subtrees are popped in bound
+ * order, so the search stops after k words without touching the rest of
+ * the subtree. Equal weights are returned alphabetically.
+ * Time: O(k*F*log(k*F)) where F = avg fan-out of expanded nodes
+ */
+template <typename Expand>
+vector<Suggestion> bestFirstTopK(uint32_t start, uint32_t startBound,
+                                 string prefix, size_t k, Expand &&expand) {
+  // A frontier entry is either a subtree (bounded by its maxWeight) or a
+  // finished word (exact weight). Words sort before their own subtree.
+  struct Entry {
+    uint32_t bound;
+    bool isWord;
+    uint32_t node;
+    string text;
+  };
+  auto worse = [](const Entry &a, const Entry &b) {
+    if (a.bound != b.bound)
+      return a.bound < b.bound;
+    if (a.text != b.text)
+      return a.text > b.text;
+    return !a.isWord && b.isWord;
+  };
+  vector<Suggestion> results;
+  if (k == 0)
+    return results;
+  priority_queue<Entry, vector<Entry>, decltype(worse)> frontier(worse);
+  frontier.push({startBound, false, start, move(prefix)});
+
+  while (!frontier.empty() && results.size() < k) {
+    Entry top = frontier.top();
+    frontier.pop();
+    if (top.isWord) {
+      results.push_back({move(top.text), top.bound});
+      continue;
+    }
+    expand(
+        top.node,
+        [&](uint32_t weight) {
+          frontier.push({weight, true, top.node, top.text});
+        },
+        [&](uint32_t child, char key, uint32_t bound) {
+          frontier.push({bound, false, child, top.text + key});
+        });
+  }
+  return results;
+}
+
+// ==================== SNAPSHOT FORMAT ====================
+/**
+ * On-disk trie snapshot: a header, then a level-order node array, then one
+ * edge label byte per node. A node's children occupy the contiguous range
+ * [firstChild, firstChild + childCount) of both arrays, with labels sorted,
+ * so the file is position-independent and usable straight from mmap.
+ * The header carries the KeyNormalizer table the keys were built with, so
+ * a mapped snapshot normalizes queries exactly as the source trie did.
+ */
+constexpr char SNAPSHOT_MAGIC[8] = {'T', 'R', 'I', 'E', 'S', 'N', 'A', 'P'};
+constexpr uint32_t SNAPSHOT_VERSION = 2;
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t nodeCount;
+  uint32_t wordCount;
+  uint32_t reserved;
+  uint64_t nodesOffset;
+  uint64_t labelsOffset;
+  unsigned char keyTable[256];
+};
+
+struct SnapshotNode {
+  uint32_t firstChild;
+  uint32_t weight;
+  uint32_t maxWeight;
+  uint16_t childCount;
+  uint8_t isEndOfWord;
+  uint8_t reserved;
+};
+
+// ==================== THREAD POOL ====================
+/**
+ * ThreadPool runs parallelFor jobs on persistent workers with work
+ * stealing. Each participant owns a contiguous slice of task indices packed
+ * into one 64-bit atomic (next | end << 32): the owner takes from the
+ * front, idle participants steal from the back of other slices. The
+ * calling thread participates too. Jobs must not throw.
+ */
+class ThreadPool {
+private:
+  struct alignas(64) Slice {
+    atomic<uint64_t> bounds;
+    Slice() : bounds(0) {}
+  };
+
+  vector<thread> workers;
+  unique_ptr<Slice[]> slices;
+  size_t participants;
+
+  mutex stateMutex;
+  condition_variable wake;
+  condition_variable finished;
+  uint64_t generation;
+  size_t running;
+  bool stopping;
+  const function<void(size_t)> *job;
+
+  static uint64_t pack(uint64_t next, uint64_t end) { return next | end << 32; }
+
+  bool takeFront(Slice &slice, size_t &task) {
+    uint64_t bounds = slice.bounds.load();
+    while (true) {
+      uint64_t next = bounds & 0xffffffffu, end = bounds >> 32;
+      if (next >= end)
+        return false;
+      if (slice.bounds.compare_exchange_weak(bounds, pack(next + 1, end))) {
+        task = next;
+        return true;
+      }
+    }
+  }
+
+  bool stealBack(Slice &slice, size_t &task) {
+    uint64_t bounds = slice.bounds.load();
+    while (true) {
+      uint64_t next = bounds & 0xffffffffu, end = bounds >> 32;
+      if (next >= end)
+        return false;
+      if (slice.bounds.compare_exchange_weak(bounds, pack(next, end - 1))) {
+        task = end - 1;
+        return true;
+      }
+    }
+  }
+
+  void runSlice(size_t self, const function<void(size_t)> &fn) {
+    size_t task;
+    while (true) {
+      if (takeFront(slices[self], task)) {
+        fn(task);
+        continue;
+      }
+      bool stole = false;
+      for (size_t i = 1; i < participants && !stole; i++)
+        stole = stealBack(slices[(self + i) % participants], task);
+      if (!stole)
+        return;
+      fn(task);
+    }
+  }
+
+  void workerLoop(size_t self) {
+    uint64_t seen = 0;
+    while (true) {
+      const function<void(size_t)> *current;
+      {
+        unique_lock<mutex> lock(stateMutex);
+        wake.wait(lock, [&] { return stopping || generation != seen; });
+        if (stopping)
+          return;
+        seen = generation;
+        current = job;
+      }
+      runSlice(self, *current);
+      lock_guard<mutex> lock(stateMutex);
+      if (--running == 0)
+        finished.notify_one();
+    }
+  }
+
+public:
+  /**
+   * threads counts the calling thread, so ThreadPool(1) runs inline
+   */
+  explicit ThreadPool(size_t threads = thread::hardware_concurrency())
+      : participants(max<size_t>(threads, 1)), generation(0), running(0),
+        stopping(false), job(nullptr) {
+    slices = make_unique<Slice[]>(participants);
+    for (size_t i = 1; i < participants; i++)
+      workers.emplace_back([this, i] { workerLoop(i); });
+  }
+
+  ~ThreadPool() {
+    {
+      lock_guard<mutex> lock(stateMutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (thread &worker : workers)
+      worker.join();
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return participants; }
+
+  /**
+   * Run fn(i) for every i in [0, count) and return when all are done.
+   * Not reentrant: one parallelFor at a time per pool.
+   */
+  void parallelFor(size_t count, const function<void(size_t)> &fn) {
+    if (count == 0)
+      return;
+    if (count > numeric_limits<uint32_t>::max())
+      throw length_error("ThreadPool: too many tasks");
+    for (size_t i = 0; i < participants; i++)
+      slices[i].bounds.store(
+          pack(count * i / participants, count * (i + 1) / participants));
+    {
+      lock_guard<mutex> lock(stateMutex);
+      job = &fn;
+      running = workers.size();
+      generation++;
+    }
+    wake.notify_all();
+    runSlice(0, fn);
+    unique_lock<mutex> lock(stateMutex);
+    finished.wait(lock, [&] { return running == 0; });
+  }
+};
+
+// ==================== SUGGESTION CACHE ====================
+/**
+ * CacheStats is a point-in-time view of SuggestionCache counters
+ */
+struct CacheStats {
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t invalidations;
+  size_t entries;
+};
+
+/**
+ * SuggestionCache is a bounded, sharded LRU of result pages keyed on the
+ * normalized prefix. Each entry holds the first entryLimit suggestions and
+ * whether that is the complete set, so any page inside that window (or any
+ * page at all, for complete entries) is served without touching the trie.
+ * Shards are independently locked to keep concurrent readers apart.
+ */
+class SuggestionCache {
+private:
+  static constexpr size_t SHARDS = 16;
+  static constexpr size_t NO_LIMIT = numeric_limits<size_t>::max();
+
+  struct Entry {
+    string key;
+    vector<string> results;
+    bool complete;
+  };
+
+  struct Shard {
+    mutex lock;
+    list<Entry> lru;
+    unordered_map<string, list<Entry>::iterator> index;
+  };
+
+  Shard shards[SHARDS];
+  size_t shardCapacity;
+  size_t entryLimit;
+  atomic<uint64_t> hits;
+  atomic<uint64_t> misses;
+  atomic<uint64_t> invalidations;
+
+  Shard &shardFor(const string &key) {
+    return shards[hash<string>()(key) % SHARDS];
+  }
+
+public:
+  SuggestionCache(size_t capacity, size_t pageWindow)
+      : shardCapacity(max<size_t>(1, (capacity + SHARDS - 1) / SHARDS)),
+        entryLimit(pageWindow), hits(0), misses(0), invalidations(0) {}
+
+  size_t window() const { return entryLimit; }
+
+  /**
+   * Copy the requested page into out if the cached entry covers it
+   * Time: O(1) average plus the page copy
+   */
+  bool lookup(const string &key, size_t limit, size_t offset,
+              vector<string> &out) {
+    Shard &shard = shardFor(key);
+    lock_guard<mutex> guard(shard.lock);
+    auto found = shard.index.find(key);
+    if (found == shard.index.end()) {
+      misses++;
+      return false;
+    }
+    const Entry &entry = *found->second;
+    size_t wanted =
+        limit > entryLimit || offset > entryLimit ? NO_LIMIT : offset + limit;
+    if (!entry.complete && (wanted == NO_LIMIT || wanted > entryLimit)) {
+      misses++;
+      return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+    size_t size = entry.results.size();
+    size_t first = min(offset, size);
+    size_t last = limit >= size - first ? size : first + limit;
+    out.assign(entry.results.begin() + first, entry.results.begin() + last);
+    hits++;
+    return true;
+  }
+
+  void store(const string &key, vector<string> results, bool complete) {
+    Shard &shard = shardFor(key);
+    lock_guard<mutex> guard(shard.lock);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end()) {
+      shard.lru.erase(found->second);
+      shard.index.erase(found);
+    }
+    shard.lru.push_front({key, move(results), complete});
+    shard.index[key] = shard.lru.begin();
+    if (shard.lru.size() > shardCapacity) {
+      shard.index.erase(shard.lru.back().key);
+      shard.lru.pop_back();
+    }
+  }
+
+  /**
+   * Drop the entries a newly added key can change: those for each of its
+   * prefixes, including the empty prefix
+   * Time: O(L) hash lookups
+   */
+  void invalidatePrefixes(const string &key) {
+    string stem;
+    for (size_t length = 0; length <= key.size(); length++) {
+      stem.assign(key, 0, length);
+      Shard &shard = shardFor(stem);
+      lock_guard<mutex> guard(shard.lock);
+      auto found = shard.index.find(stem);
+      if (found != shard.index.end()) {
+        shard.lru.erase(found->second);
+        shard.index.erase(found);
+        invalidations++;
+      }
+    }
+  }
+
+  /**
+   * Drop every entry, for bulk writes that touch too many prefixes to
+   * invalidate one key at a time
+   * Time: O(entries)
+   */
+  void clear() {
+    for (Shard &shard : shards) {
+      lock_guard<mutex> guard(shard.lock);
+      invalidations += shard.lru.size();
+      shard.index.clear();
+      shard.lru.clear();
+    }
+  }
+
+  CacheStats stats() {
+    size_t entries = 0;
+    for (Shard &shard : shards) {
+      lock_guard<mutex> guard(shard.lock);
+      entries += shard.lru.size();
+    }
+    return {hits.load(), misses.load(), invalidations.load(), entries};
+  }
+};
+
+// ==================== METRICS ====================
+/**
+ * Log2Histogram counts samples in power-of-two buckets: bucket 0 holds 0
+ * and bucket b holds [2^(b-1), 2^b). Recording is a few relaxed atomic
+ * adds, so it is cheap enough to leave on and can be read from another
+ * thread while queries run.
+ */
+class Log2Histogram {
+public:
+  static constexpr size_t BUCKETS = 64;
+
+private:
+  atomic<uint64_t> buckets[BUCKETS] = {};
+  atomic<uint64_t> samples{0};
+  atomic<uint64_t> total{0};
+
+  static size_t bucketFor(uint64_t value) {
+#if defined(__GNUC__)
+    size_t bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+#else
+    size_t bucket = 0;
+    for (; value != 0; value >>= 1)
+      bucket++;
+#endif
+    return min(bucket, BUCKETS - 1);
+  }
+
+public:
+  void record(uint64_t value) {
+    buckets[bucketFor(value)].fetch_add(1, memory_order_relaxed);
+    samples.fetch_add(1, memory_order_relaxed);
+    total.fetch_add(value, memory_order_relaxed);
+  }
+
+  uint64_t count() const { return samples.load(memory_order_relaxed); }
+  uint64_t sum() const { return total.load(memory_order_relaxed); }
+  uint64_t bucket(size_t index) const {
+    return buckets[index].load(memory_order_relaxed);
+  }
+
+  /** Largest value bucket b can hold */
+  static uint64_t upperBound(size_t index) {
+    return index == 0 ? 0 : (uint64_t(1) << (index - 1)) * 2 - 1;
+  }
+
+  /**
+   * Upper bound of the bucket holding the q-th quantile (0 if empty);
+   * accurate to within a factor of two
+   */
+  uint64_t quantile(double q) const {
+    uint64_t seen = 0, target = static_cast<uint64_t>(q * count());
+    for (size_t b = 0; b < BUCKETS; b++) {
+      seen += bucket(b);
+      if (seen > target)
+        return upperBound(b);
+    }
+    return 0;
+  }
+
+  /**
+   * Append this histogram in Prometheus text format. labels is either
+   * empty or a comma-terminated list such as op="insert",
+   */
+  void writePrometheus(string &out, const string &name,
+                       const string &labels) const {
+    size_t last = 0;
+    for (size_t b = 0; b < BUCKETS; b++) {
+      if (bucket(b) != 0)
+        last = b;
+    }
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b <= last; b++) {
+      cumulative += bucket(b);
+      out += name + "_bucket{" + labels + "le=\"" +
+             to_string(upperBound(b)) + "\"} " + to_string(cumulative) + "\n";
+    }
+    string braces = labels.empty()
+                        ? string()
+                        : "{" + labels.substr(0, labels.size() - 1) + "}";
+    out += name + "_bucket{" + labels + "le=\"+Inf\"} " +
+           to_string(count()) + "\n";
+    out += name + "_sum" + braces + " " + to_string(sum()) + "\n";
+    out += name + "_count" + braces + " " + to_string(count()) + "\n";
+  }
+};
+
+/**
+ * TrieMetrics is the live instrumentation a Trie records into once
+ * enableMetrics() is called: per-operation latency in nanoseconds, nodes
+ * visited and words returned per suggestion query, and bulk-loaded words.
+ */
+struct TrieMetrics {
+  enum Operation { INSERT, REMOVE, SUGGEST, TOPK, FUZZY, OPERATIONS };
+  static constexpr const char *OPERATION_NAMES[OPERATIONS] = {
+      "insert", "remove", "suggest", "topk", "fuzzy"};
+
+  Log2Histogram latency[OPERATIONS];
+  Log2Histogram nodesVisited;
+  Log2Histogram resultSize;
+  atomic<uint64_t> bulkLoaded{0};
+};
+
+/**
+ * Records the lifetime of a scope into a latency histogram; a null
+ * histogram (metrics disabled) skips the clock reads entirely
+ */
+class ScopedTimer {
+private:
+  Log2Histogram *histogram;
+  chrono::steady_clock::time_point start;
+
+public:
+  explicit ScopedTimer(Log2Histogram *target) : histogram(target) {
+    if (histogram)
+      start = chrono::steady_clock::now();
+  }
+  ~ScopedTimer() {
+    if (histogram)
+      histogram->record(static_cast<uint64_t>(
+          chrono::duration_cast<chrono::nanoseconds>(
+              chrono::steady_clock::now() - start)
+              .count()));
+  }
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+};
+
+/**
+ * Structural snapshot of a trie, computed from counters kept on insert and
+ * remove. maxDepth is a high-water mark: removals do not lower it.
+ */
+struct ShapeStats {
+  uint32_t nodes;
+  size_t bytes;
+  size_t maxDepth;
+  double averageFanout;
+};
+
+// ==================== SUCCINCT BIT VECTOR ====================
+/**
+ * RankSelectBits is an append-only bit vector with constant-time rank and
+ * near-constant select. Alongside the raw bits it keeps one cumulative
+ * popcount per 512-bit block and the block of every 512th zero, about 7%
+ * extra space.
+ * rank1: O(1), select0: O(1) expected (a short block scan from a sample)
+ */
+class RankSelectBits {
+private:
+  static constexpr size_t BLOCK_BITS = 512;
+  static constexpr size_t WORDS_PER_BLOCK = BLOCK_BITS / 64;
+  static constexpr size_t ZERO_SAMPLE = 512;
+
+  vector<uint64_t> words;
+  vector<uint32_t> blockRanks;
+  vector<uint32_t> zeroSamples;
+  size_t length = 0;
+
+  static size_t popcount(uint64_t word) { return bitset<64>(word).count(); }
+
+  size_t zerosBeforeBlock(size_t block) const {
+    return block * BLOCK_BITS - blockRanks[block];
+  }
+
+public:
+  void push(bool bit) {
+    if (length % 64 == 0)
+      words.push_back(0);
+    if (bit)
+      words.back() |= uint64_t(1) << (length % 64);
+    length++;
+  }
+
+  /**
+   * Build the rank and select directories; call once after the last push
+   */
+  void finish() {
+    size_t blocks = (words.size() + WORDS_PER_BLOCK - 1) / WORDS_PER_BLOCK;
+    blockRanks.assign(blocks + 1, 0);
+    zeroSamples.clear();
+    size_t ones = 0, zeros = 0;
+    for (size_t b = 0; b < blocks; b++) {
+      blockRanks[b] = static_cast<uint32_t>(ones);
+      size_t last = min(words.size(), (b + 1) * WORDS_PER_BLOCK);
+      size_t blockOnes = 0;
+      for (size_t w = b * WORDS_PER_BLOCK; w < last; w++)
+        blockOnes += popcount(words[w]);
+      size_t blockZeros =
+          min(BLOCK_BITS, length - b * BLOCK_BITS) - blockOnes;
+      while (zeroSamples.size() * ZERO_SAMPLE < zeros + blockZeros)
+        zeroSamples.push_back(static_cast<uint32_t>(b));
+      ones += blockOnes;
+      zeros += blockZeros;
+    }
+    blockRanks[blocks] = static_cast<uint32_t>(ones);
+    words.shrink_to_fit();
+  }
+
+  bool get(size_t index) const {
+    return (words[index / 64] >> (index % 64)) & 1;
+  }
+
+  /** Number of set bits in [0, index) */
+  size_t rank1(size_t index) const {
+    size_t block = index / BLOCK_BITS;
+    size_t count = blockRanks[block];
+    for (size_t w = block * WORDS_PER_BLOCK; w < index / 64; w++)
+      count += popcount(words[w]);
+    if (index % 64)
+      count += popcount(words[index / 64] & ((uint64_t(1) << (index % 64)) - 1));
+    return count;
+  }
+
+  /** Position of the k-th clear bit, counting from 0 */
+  size_t select0(size_t k) const {
+    size_t block = zeroSamples[k / ZERO_SAMPLE];
+    while (block + 1 < blockRanks.size() - 1 &&
+           zerosBeforeBlock(block + 1) <= k)
+      block++;
+    size_t remaining = k - zerosBeforeBlock(block);
+    for (size_t w = block * WORDS_PER_BLOCK;; w++) {
+      uint64_t zeros = ~words[w];
+      size_t count = popcount(zeros);
+      if (remaining < count) {
+        for (; remaining > 0; remaining--)
+          zeros &= zeros - 1;
+        return w * 64 + bitset<64>((zeros & -zeros) - 1).count();
+      }
+      remaining -= count;
+    }
+  }
+
+  size_t size() const { return length; }
+  size_t memoryUsage() const {
+    return words.capacity() * sizeof(uint64_t) +
+           blockRanks.capacity() * sizeof(uint32_t) +
+           zeroSamples.capacity() * sizeof(uint32_t);
+  }
+};
+
+// ==================== FROZEN TRIE ====================
+/**
+ * FrozenTrie is the static, succinct form produced by Trie::freeze(). The
+ * shape is a LOUDS bit string: nodes are numbered in level order and node
+ * v contributes one 1 per child followed by a 0, so v's children are the
+ * contiguous ids starting at select0(v - 1) - v + 2. Per node it keeps the
+ * incoming edge label, an end-of-word bit and an 8-bit quantized subtree
+ * bound for top-K; exact weights are stored only for words.
+ * Space: about 2 + 1 + 8 + 8 bits per node plus 32 bits per word
+ */
+class FrozenTrie {
+private:
+  static constexpr uint32_t ROOT = 0;
+  static constexpr uint32_t NO_NODE = numeric_limits<uint32_t>::max();
+  static constexpr size_t NO_LIMIT = numeric_limits<size_t>::max();
+
+  RankSelectBits louds;
+  RankSelectBits terminal;
+  vector<unsigned char> labels;
+  vector<uint8_t> bounds;
+  vector<uint32_t> weights;
+  KeyNormalizer normalizer;
+  uint32_t nodeCount;
+
+  friend class Trie;
+
+  /**
+   * Decoded upper bound for each 8-bit code: exact up to small weights,
+   * then geometric (about 9% per step) up to UINT32_MAX
+   */
+  static const array<uint32_t, 256> &boundTable() {
+    static const array<uint32_t, 256> table = [] {
+      array<uint32_t, 256> values{};
+      double step = log(double(numeric_limits<uint32_t>::max())) / 255;
+      for (size_t code = 1; code < 256; code++) {
+        double geometric = ceil(exp(step * code));
+        values[code] = static_cast<uint32_t>(
+            max<double>(values[code - 1] + 1.0,
+                        min<double>(geometric, numeric_limits<uint32_t>::max())));
+      }
+      values[255] = numeric_limits<uint32_t>::max();
+      return values;
+    }();
+    return table;
+  }
+
+  /** Smallest code whose decoded bound is at least weight (rounds up) */
+  static uint8_t quantize(uint32_t weight) {
+    const array<uint32_t, 256> &table = boundTable();
+    return static_cast<uint8_t>(
+        lower_bound(table.begin(), table.end(), weight) - table.begin());
+  }
+
+  /** Children of node v are ids [first, first + count) */
+  void childRange(uint32_t node, uint32_t &first, uint32_t &count) const {
+    size_t begin = node == ROOT ? 0 : louds.select0(node - 1) + 1;
+    size_t end = louds.select0(node);
+    first = static_cast<uint32_t>(begin - node + 1);
+    count = static_cast<uint32_t>(end - begin);
+  }
+
+  uint32_t findChild(uint32_t node, unsigned char ch) const {
+    uint32_t first, count;
+    childRange(node, first, count);
+    size_t pos = findLabel(labels.data() + first, count, ch);
+    return pos == count ? NO_NODE : first + static_cast<uint32_t>(pos);
+  }
+
+  uint32_t locate(string_view raw) const {
+    uint32_t current = ROOT;
+    for (char byte : normalizer.trimmed(raw)) {
+      unsigned char ch = normalizer.map(byte);
+      if (ch == 0)
+        continue;
+      current = findChild(current, ch);
+      if (current == NO_NODE)
+        return NO_NODE;
+    }
+    return current;
+  }
+
+  uint32_t weightOf(uint32_t node) const {
+    return weights[terminal.rank1(node)];
+  }
+
+public:
+  explicit FrozenTrie(const KeyNormalizer &keys = KeyNormalizer::letters())
+      : normalizer(keys), nodeCount(0) {}
+
+  bool contains(string_view word) const {
+    if (nodeCount == 0)
+      return false;
+    uint32_t node = locate(word);
+    return node != NO_NODE && terminal.get(node);
+  }
+
+  /**
+   * Stream suggestions in sorted order, same contract as
+   * Trie::forEachSuggestion
+   * Time: O(L + V) where V = nodes visited to fill the page
+   */
+  template <typename Visitor>
+  void forEachSuggestion(string_view prefix, Visitor &&visit,
+                         size_t limit = NO_LIMIT,
+                         size_t offset = 0) const {
+    if (nodeCount == 0 || limit == 0)
+      return;
+    uint32_t start = locate(prefix);
+    if (start == NO_NODE)
+      return;
+    string buffer = normalizer.normalize(prefix);
+
+    struct Frame {
+      uint32_t next;
+      uint32_t end;
+    };
+    auto emit = [&](uint32_t node) {
+      if (!terminal.get(node))
+        return true;
+      if (offset > 0) {
+        offset--;
+        return true;
+      }
+      return visit(static_cast<const string &>(buffer)) && --limit != 0;
+    };
+    auto frameFor = [&](uint32_t node) {
+      uint32_t first, count;
+      childRange(node, first, count);
+      return Frame{first, first + count};
+    };
+    if (!emit(start))
+      return;
+    vector<Frame> stack{frameFor(start)};
+    while (!stack.empty()) {
+      Frame &top = stack.back();
+      if (top.next == top.end) {
+        stack.pop_back();
+        if (!stack.empty())
+          buffer.pop_back();
+        continue;
+      }
+      uint32_t child = top.next++;
+      buffer.push_back(static_cast<char>(labels[child]));
+      stack.push_back(frameFor(child));
+      if (!emit(child))
+        return;
+    }
+  }
+
+  vector<string> getSuggestions(string_view prefix,
+                                size_t limit = NO_LIMIT,
+                                size_t offset = 0) const {
+    vector<string> results;
+    forEachSuggestion(
+        prefix,
+        [&](const string &word) {
+          results.push_back(word);
+          return true;
+        },
+        limit, offset);
+    return results;
+  }
+
+  /**
+   * Same ranking as Trie::getTopK. Subtree bounds are quantized upwards,
+   * so they never undercut a real weight and the answer stays exact; a
+   * looser bound only means an occasional extra expansion.
+   */
+  vector<Suggestion> getTopK(string_view prefix, size_t k) const {
+    if (nodeCount == 0)
+      return {};
+    uint32_t start = locate(prefix);
+    if (start == NO_NODE)
+      return {};
+    const array<uint32_t, 256> &table = boundTable();
+    return bestFirstTopK(
+        start, table[bounds[start]], normalizer.normalize(prefix), k,
+        [&](uint32_t node, auto &&pushWord, auto &&pushChild) {
+          if (terminal.get(node))
+            pushWord(weightOf(node));
+          uint32_t first, count;
+          childRange(node, first, count);
+          for (uint32_t c = first; c < first + count; c++)
+            pushChild(c, static_cast<char>(labels[c]), table[bounds[c]]);
+        });
+  }
+
+  int getWordCount() const { return static_cast<int>(weights.size()); }
+  uint32_t getNodeCount() const { return nodeCount; }
+  size_t getMemoryUsage() const {
+    return louds.memoryUsage() + terminal.memoryUsage() + labels.capacity() +
+           bounds.capacity() + weights.capacity() * sizeof(uint32_t);
+  }
+};
+
+// ==================== TRIE CLASS ====================
+/**
+ * Trie implements a prefix tree for efficient word storage and retrieval.
+ * All nodes live in a NodePool; the root is always index 0.
+ */
+class Trie {
+public:
+  static constexpr size_t NO_LIMIT = numeric_limits<size_t>::max();
+
+private:
+  static constexpr uint32_t ROOT = 0;
+  static constexpr uint32_t NO_NODE = numeric_limits<uint32_t>::max();
+
+  NodePool<TrieNode> nodes;
+  vector<WideChildren> wideChildren;
+  vector<uint32_t> freeWide;
+  KeyNormalizer normalizer;
+  string scratchKey;
+  vector<uint32_t> scratchPath;
+  int wordCount;
+  uint64_t version;
+  uint32_t internalNodes;
+  size_t maxDepth;
+  unique_ptr<SuggestionCache> cache;
+  unique_ptr<TrieMetrics> metrics;
+
+  Log2Histogram *latencyFor(TrieMetrics::Operation operation) const {
+    return metrics ? &metrics->latency[operation] : nullptr;
+  }
+
+  friend class SuggestSession;
+
+  /**
+   * Find child of node labelled ch, or NO_NODE if absent
+   * Time Complexity: O(1) - at most INLINE_CHILDREN compares or one rank
+   */
+  uint32_t findChild(const TrieNode &node, unsigned char ch) const {
+    if (!node.isWide()) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      for (uint16_t i = 0; i < node.childCount; i++) {
+        if (node.labels[i] == ch)
+          return node.slots[i];
+      }
+      return NO_NODE;
+#else
+      // SWAR: XOR all four labels with ch at once and flag the zero bytes.
+      // Borrows only carry upwards, so the lowest flag is always exact;
+      // slots past childCount are masked off.
+      static constexpr uint32_t LIVE[TrieNode::INLINE_CHILDREN + 1] = {
+          0, 0x80u, 0x8080u, 0x808080u, 0x80808080u};
+      uint32_t packed;
+      memcpy(&packed, node.labels, sizeof(packed));
+      uint32_t diff = packed ^ (0x01010101u * ch);
+      uint32_t zero =
+          (diff - 0x01010101u) & ~diff & LIVE[node.childCount];
+      return zero ? node.slots[lowestSetBit(zero) / 8] : NO_NODE;
+#endif
+    }
+    const WideChildren &wide = wideChildren[node.slots[0]];
+    return wide.contains(ch) ? wide.children[wide.rank(ch)] : NO_NODE;
+  }
+
+  /**
+   * Attach child under node with label ch, keeping labels sorted and
+   * promoting the node to a WideChildren table when the inline array fills.
+   */
+  void addChild(TrieNode &node, unsigned char ch, uint32_t child) {
+    if (node.childCount == 0)
+      internalNodes++;
+    if (node.childCount < TrieNode::INLINE_CHILDREN) {
+      uint16_t pos = node.childCount;
+      while (pos > 0 && node.labels[pos - 1] > ch) {
+        node.labels[pos] = node.labels[pos - 1];
+        node.slots[pos] = node.slots[pos - 1];
+        pos--;
+      }
+      node.labels[pos] = ch;
+      node.slots[pos] = child;
+    } else {
+      if (!node.isWide()) {
+        WideChildren wide;
+        for (uint16_t i = 0; i < node.childCount; i++)
+          wide.add(node.labels[i], node.slots[i]);
+        if (freeWide.empty()) {
+          wideChildren.push_back(move(wide));
+          node.slots[0] = static_cast<uint32_t>(wideChildren.size() - 1);
+        } else {
+          node.slots[0] = freeWide.back();
+          freeWide.pop_back();
+          wideChildren[node.slots[0]] = move(wide);
+        }
+      }
+      wideChildren[node.slots[0]].add(ch, child);
+    }
+    node.childCount++;
+  }
+
+  /**
+   * Unlink the child labelled ch, which must exist. A wide node that drops
+   * back to INLINE_CHILDREN children is moved inline again and its
+   * WideChildren slot is recycled.
+   * Time: O(fan-out)
+   */
+  void removeChild(TrieNode &node, unsigned char ch) {
+    if (!node.isWide()) {
+      uint16_t pos = 0;
+      while (node.labels[pos] != ch)
+        pos++;
+      for (; pos + 1 < node.childCount; pos++) {
+        node.labels[pos] = node.labels[pos + 1];
+        node.slots[pos] = node.slots[pos + 1];
+      }
+      if (--node.childCount == 0)
+        internalNodes--;
+      return;
+    }
+    uint32_t slot = node.slots[0];
+    WideChildren &wide = wideChildren[slot];
+    wide.remove(ch);
+    node.childCount--;
+    if (node.isWide())
+      return;
+    uint16_t pos = 0;
+    for (int label = 0; label < 256; label++) {
+      if (wide.contains(static_cast<unsigned char>(label))) {
+        node.labels[pos] = static_cast<unsigned char>(label);
+        node.slots[pos] = wide.children[pos];
+        pos++;
+      }
+    }
+    wide = WideChildren();
+    freeWide.push_back(slot);
+  }
+
+  /**
+   * Highest weight in node's subtree, recomputed from its own weight and
+   * its children's bounds
+   * Time: O(fan-out)
+   */
+  uint32_t subtreeMaxWeight(const TrieNode &node) const {
+    uint32_t best = node.isEndOfWord ? node.weight : 0;
+    forEachChild(node, [&](char, uint32_t child) {
+      best = max(best, nodes[child].maxWeight);
+      return true;
+    });
+    return best;
+  }
+
+  /**
+   * Visit children of node in ascending label order until visit returns
+   * false; returns false if the walk was stopped early
+   */
+  template <typename Visitor>
+  bool forEachChild(const TrieNode &node, Visitor &&visit) const {
+    if (!node.isWide()) {
+      for (uint16_t i = 0; i < node.childCount; i++) {
+        if (!visit(static_cast<char>(node.labels[i]), node.slots[i]))
+          return false;
+      }
+      return true;
+    }
+    const WideChildren &wide = wideChildren[node.slots[0]];
+    size_t pos = 0;
+    for (int ch = 0; ch < 256; ch++) {
+      if (wide.contains(static_cast<unsigned char>(ch)) &&
+          !visit(static_cast<char>(ch), wide.children[pos++]))
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * Step cursor to the next child of node in ascending label order. For
+   * inline nodes the cursor is an array position; for wide nodes it is the
+   * next label value to probe. Returns false when no children remain.
+   */
+  bool nextChild(const TrieNode &node, uint16_t &cursor, char &label,
+                 uint32_t &child) const {
+    if (!node.isWide()) {
+      if (cursor >= node.childCount)
+        return false;
+      label = static_cast<char>(node.labels[cursor]);
+      child = node.slots[cursor++];
+      return true;
+    }
+    const WideChildren &wide = wideChildren[node.slots[0]];
+    while (cursor < 256) {
+      unsigned char ch = static_cast<unsigned char>(cursor++);
+      if (wide.contains(ch)) {
+        label = static_cast<char>(ch);
+        child = wide.children[wide.rank(ch)];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * Insert an already-normalized key. path[0..depth] must hold the nodes
+   * for key[0..depth); the walk resumes at path[depth] and path is extended
+   * to the full key. Every node on the path has its maxWeight raised.
+   * The result cache is left to the caller, which invalidates per key or
+   * clears it once per bulk load.
+   * Time: O(L)
+   */
+  void insertKey(const string &key, size_t depth, vector<uint32_t> &path,
+                 uint32_t weight) {
+    if (key.empty())
+      return;
+    extendKey(key, depth, path, weight);
+    for (uint32_t node : path)
+      nodes[node].maxWeight = max(nodes[node].maxWeight, weight);
+  }
+
+  /**
+   * insertKey without the maxWeight updates, which are left to the caller.
+   * Once a node is freshly allocated every node below it is new too, so
+   * child lookups are skipped for the rest of the key.
+   * Time: O(L - depth)
+   */
+  void extendKey(const string &key, size_t depth, vector<uint32_t> &path,
+                 uint32_t weight) {
+    uint32_t current = path[depth];
+    bool fresh = false;
+    for (size_t i = depth; i < key.size(); i++) {
+      unsigned char ch = static_cast<unsigned char>(key[i]);
+      uint32_t child = fresh ? NO_NODE : findChild(nodes[current], ch);
+      if (child == NO_NODE) {
+        child = nodes.allocate();
+        addChild(nodes[current], ch, child);
+        fresh = true;
+      }
+      current = child;
+      path.push_back(current);
+    }
+    TrieNode &last = nodes[current];
+    if (!last.isEndOfWord) {
+      last.isEndOfWord = true;
+      wordCount++;
+      maxDepth = max(maxDepth, key.size());
+    }
+    last.weight = max(last.weight, weight);
+    version++;
+  }
+
+  /**
+   * Find node index for a given prefix, or NO_NODE if absent
+   * Time Complexity: O(L) where L = prefix length
+   */
+  uint32_t searchPrefix(const string &prefix) const {
+    uint32_t current = ROOT;
+    for (char ch : prefix) {
+      current = findChild(nodes[current], static_cast<unsigned char>(ch));
+      if (current == NO_NODE) {
+        return NO_NODE;
+      }
+    }
+    return current;
+  }
+
+  /**
+   * Find the node for raw input without building a key: whitespace is
+   * trimmed by narrowing the view and each byte is normalized as the walk
+   * descends. Misses therefore cost no allocation at all.
+   * Time: O(L)
+   */
+  uint32_t locate(string_view raw) const {
+    uint32_t current = ROOT;
+    for (char byte : normalizer.trimmed(raw)) {
+      unsigned char ch = normalizer.map(byte);
+      if (ch == 0)
+        continue;
+      current = findChild(nodes[current], ch);
+      if (current == NO_NODE)
+        return NO_NODE;
+    }
+    return current;
+  }
+
+  /**
+   * Read-only counterpart of insertKey: resume at path[depth] and extend
+   * path along key. Returns the node for key, or NO_NODE with path holding
+   * the longest matched stem.
+   * Time: O(L - depth)
+   */
+  uint32_t descend(const string &key, size_t depth,
+                   vector<uint32_t> &path) const {
+    for (size_t i = depth; i < key.size(); i++) {
+      uint32_t child =
+          findChild(nodes[path.back()], static_cast<unsigned char>(key[i]));
+      if (child == NO_NODE)
+        return NO_NODE;
+      path.push_back(child);
+    }
+    return path.back();
+  }
+
+  /**
+   * Stream words below node (whose spelled path is prefix) to visit,
+   * honouring the same limit/offset contract as forEachSuggestion.
+   * Returns the number of nodes the walk entered.
+   */
+  template <typename Visitor>
+  size_t emitSuggestions(uint32_t node, string prefix, Visitor &visit,
+                         size_t limit, size_t offset) const {
+    if (node == NO_NODE || limit == 0)
+      return 0;
+    WordIterator it(this, node, move(prefix)), end;
+    for (; it != end; ++it) {
+      if (offset > 0) {
+        offset--;
+        continue;
+      }
+      if (!visit((*it).word) || --limit == 0)
+        break;
+    }
+    return it.nodesVisited();
+  }
+
+  /**
+   * Depth-first Levenshtein walk for getFuzzySuggestions. rows[depth] is the
+   * edit-distance row of the path spelled in buffer against query; once
+   * its last cell is within maxEdits the whole subtree matches and is
+   * emitted in order, and once every cell exceeds maxEdits no extension
+   * can match, so the subtree is pruned. Depth is bounded by
+   * query length + maxEdits, so plain recursion is safe here.
+   * Returns false once the limit is reached.
+   */
+  template <typename Visitor>
+  bool fuzzyWalk(uint32_t node, const string &query, size_t maxEdits,
+                 vector<vector<size_t>> &rows, string &buffer, Visitor &visit,
+                 size_t &remaining) const {
+    const vector<size_t> &row = rows[buffer.size()];
+    if (row.back() <= maxEdits) {
+      bool more = true;
+      auto emit = [&](const string &word) {
+        more = visit(word) && --remaining > 0;
+        return more;
+      };
+      emitSuggestions(node, buffer, emit, remaining, 0);
+      return more;
+    }
+    if (*min_element(row.begin(), row.end()) > maxEdits)
+      return true;
+
+    return forEachChild(nodes[node], [&](char key, uint32_t child) {
+      size_t depth = buffer.size() + 1;
+      if (rows.size() <= depth)
+        rows.emplace_back(query.size() + 1);
+      const vector<size_t> &above = rows[depth - 1];
+      vector<size_t> &next = rows[depth];
+      next[0] = above[0] + 1;
+      for (size_t j = 1; j <= query.size(); j++) {
+        size_t substitute = above[j - 1] + (query[j - 1] == key ? 0 : 1);
+        next[j] = min({substitute, above[j] + 1, next[j - 1] + 1});
+      }
+      buffer.push_back(key);
+      bool more =
+          fuzzyWalk(child, query, maxEdits, rows, buffer, visit, remaining);
+      buffer.pop_back();
+      return more;
+    });
+  }
+
+public:
+  explicit Trie(const KeyNormalizer &keys = KeyNormalizer::letters())
+      : normalizer(keys), wordCount(0), version(0), internalNodes(0),
+        maxDepth(0) {
+    nodes.allocate();
+  }
+
+  /**
+   * Insert word into Trie with a ranking weight. Re-inserting an existing
+   * word keeps the higher of its old and new weights. The key and path
+   * are built in scratch buffers owned by the trie, so steady-state
+   * inserts do not allocate.
+   * Time: O(L), Space: O(L) worst case
+   */
+  void insert(string_view word, uint32_t weight = 1) {
+    ScopedTimer timer(latencyFor(TrieMetrics::INSERT));
+    normalizer.normalize(word, scratchKey);
+    scratchPath.assign(1, ROOT);
+    int before = wordCount;
+    insertKey(scratchKey, 0, scratchPath, weight);
+    if (cache && wordCount > before)
+      cache->invalidatePrefixes(scratchKey);
+  }
+
+  /**
+   * Check whether word is stored - Time: O(L), no allocation
+   */
+  bool contains(string_view word) const {
+    uint32_t node = locate(word);
+    return node != NO_NODE && nodes[node].isEndOfWord;
+  }
+
+  /**
+   * Set weight to word's stored weight; false if word is not stored
+   * Time: O(L), no allocation
+   */
+  bool findWeight(string_view word, uint32_t &weight) const {
+    uint32_t node = locate(word);
+    if (node == NO_NODE || !nodes[node].isEndOfWord)
+      return false;
+    weight = nodes[node].weight;
+    return true;
+  }
+
+  /**
+   * Whether insert(word, weight) would change anything: false if word
+   * normalizes to an empty key or is already stored with at least weight
+   * Time: O(L), no allocation
+   */
+  bool insertWouldChange(string_view word, uint32_t weight) const {
+    uint32_t node = locate(word);
+    return node != ROOT && (node == NO_NODE || !nodes[node].isEndOfWord ||
+                            nodes[node].weight < weight);
+  }
+
+  /**
+   * Bulk-load words pushed by produce(emit), where emit(word, weight) is
+   * called once per word. Each key resumes from the node path of the
+   * previous key at their longest common prefix, so a stem shared with
+   * the previous key is never descended again. maxWeight is built bottom
+   * up: best[i] holds the heaviest weight below path[i] since that node
+   * joined the path, and is folded into the node and its parent's entry
+   * when the node leaves it. On sorted input each node joins the path
+   * once, so the trie is built in a single pass that settles every
+   * maxWeight exactly once. Any other order is still correct; a node that
+   * rejoins the path is merely settled again.
+   * Time: O(total characters - resumed bytes)
+   */
+  template <typename Producer> LoadStats loadWords(Producer &&produce) {
+    LoadStats stats{0, 0, true, 0, 0};
+    string key, previous;
+    vector<uint32_t> path{ROOT};
+    vector<uint32_t> best{0};
+    auto settle = [&](size_t depth) {
+      for (size_t i = path.size() - 1; i > depth; i--) {
+        nodes[path[i]].maxWeight = max(nodes[path[i]].maxWeight, best[i]);
+        best[i - 1] = max(best[i - 1], best[i]);
+      }
+      path.resize(depth + 1);
+      best.resize(depth + 1);
+    };
+    int before = wordCount;
+    produce([&](string_view word, uint32_t weight) {
+      stats.lines++;
+      normalizer.normalize(word, key);
+      if (key.empty())
+        return;
+
+      if (key < previous)
+        stats.sorted = false;
+      size_t common = 0;
+      size_t limit = min(key.size(), path.size() - 1);
+      while (common < limit && key[common] == previous[common])
+        common++;
+      stats.keyBytes += key.size();
+      stats.resumedBytes += common;
+      settle(common);
+      extendKey(key, common, path, weight);
+      best.resize(path.size(), 0);
+      best.back() = max(best.back(), weight);
+      swap(previous, key);
+    });
+    settle(0);
+    nodes[ROOT].maxWeight = max(nodes[ROOT].maxWeight, best[0]);
+    stats.added = static_cast<size_t>(wordCount - before);
+    // One sweep instead of L shard locks per new word
+    if (cache && stats.added > 0)
+      cache->clear();
+    if (metrics)
+      metrics->bulkLoaded.fetch_add(stats.added, memory_order_relaxed);
+    return stats;
+  }
+
+  /**
+   * Stream words from in, one per line as "word" or "word<TAB>weight"
+   * Time: O(total characters)
+   */
+  LoadStats loadFromStream(istream &in) {
+    return loadWords([&](auto &&emit) {
+      for (string line; getline(in, line);) {
+        uint32_t weight = splitWeight(line);
+        emit(line, weight);
+      }
+    });
+  }
+
+  /**
+   * Load a word list from disk; returns false if the file cannot be opened
+   */
+  bool loadFromFile(const string &filePath, LoadStats &stats) {
+    ifstream in(filePath);
+    if (!in)
+      return false;
+    stats = loadFromStream(in);
+    return true;
+  }
+
+  /**
+   * Build from a word list on several threads. Words are bucketed by their
+   * first key byte, each bucket becomes an independent shard Trie with its
+   * own arena, and the shards are then relocated into this trie's arena in
+   * parallel and attached under the root. weights, when given, is
+   * parallel to words. Falls back to a serial loadWords when the trie
+   * already holds words. Either way the result cache is cleared once.
+   * Time: O(total chars / threads + N) with N = nodes
+   */
+  void buildParallel(const vector<string> &words, ThreadPool &pool,
+                     const vector<uint32_t> *weights = nullptr) {
+    auto weightOf = [&](size_t i) { return weights ? (*weights)[i] : 1u; };
+    if (wordCount > 0 || nodes[ROOT].childCount > 0) {
+      loadWords([&](auto &&emit) {
+        for (size_t i = 0; i < words.size(); i++)
+          emit(words[i], weightOf(i));
+      });
+      return;
+    }
+
+    vector<string> keys(words.size());
+    size_t blocks = (words.size() + 4095) / 4096;
+    pool.parallelFor(blocks, [&](size_t b) {
+      size_t last = min(words.size(), (b + 1) * 4096);
+      for (size_t i = b * 4096; i < last; i++)
+        normalizer.normalize(words[i], keys[i]);
+    });
+
+    vector<vector<uint32_t>> buckets(256);
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (!keys[i].empty())
+        buckets[static_cast<unsigned char>(keys[i][0])].push_back(
+            static_cast<uint32_t>(i));
+    }
+    vector<unsigned char> used;
+    for (int b = 0; b < 256; b++) {
+      if (!buckets[b].empty())
+        used.push_back(static_cast<unsigned char>(b));
+    }
+
+    vector<Trie> shards(used.size());
+    pool.parallelFor(used.size(), [&](size_t s) {
+      vector<uint32_t> path;
+      for (uint32_t index : buckets[used[s]]) {
+        path.assign(1, ROOT);
+        shards[s].insertKey(keys[index], 0, path, weightOf(index));
+      }
+    });
+
+    // Shard node i (i >= 1) lands at nodeBase[s] + i - 1; the shard root is
+    // dropped and its single child is attached under our root instead.
+    vector<uint32_t> nodeBase(shards.size()), wideBase(shards.size());
+    for (size_t s = 0; s < shards.size(); s++) {
+      nodeBase[s] = nodes.allocateRange(shards[s].nodes.size() - 1);
+      wideBase[s] = static_cast<uint32_t>(wideChildren.size());
+      wideChildren.resize(wideChildren.size() + shards[s].wideChildren.size());
+    }
+    pool.parallelFor(shards.size(), [&](size_t s) {
+      Trie &shard = shards[s];
+      auto relocate = [&](uint32_t index) { return nodeBase[s] + index - 1; };
+      for (uint32_t i = 1; i < shard.nodes.size(); i++) {
+        TrieNode node = shard.nodes[i];
+        if (node.isWide()) {
+          node.slots[0] += wideBase[s];
+        } else {
+          for (uint16_t c = 0; c < node.childCount; c++)
+            node.slots[c] = relocate(node.slots[c]);
+        }
+        nodes[relocate(i)] = node;
+      }
+      for (size_t w = 0; w < shard.wideChildren.size(); w++) {
+        WideChildren wide = move(shard.wideChildren[w]);
+        for (uint32_t &child : wide.children)
+          child = relocate(child);
+        wideChildren[wideBase[s] + w] = move(wide);
+      }
+    });
+
+    for (size_t s = 0; s < shards.size(); s++) {
+      const TrieNode &shardRoot = shards[s].nodes[ROOT];
+      addChild(nodes[ROOT], used[s], nodeBase[s] + shardRoot.slots[0] - 1);
+      nodes[ROOT].maxWeight = max(nodes[ROOT].maxWeight, shardRoot.maxWeight);
+      wordCount += shards[s].wordCount;
+      // The shard root is dropped; every other internal node carries over
+      internalNodes += shards[s].internalNodes - 1;
+      maxDepth = max(maxDepth, shards[s].maxDepth);
+    }
+    if (cache && wordCount > 0)
+      cache->clear();
+    if (metrics)
+      metrics->bulkLoaded.fetch_add(static_cast<uint64_t>(wordCount),
+                                    memory_order_relaxed);
+    version++;
+  }
+
+  // ==================== WORD ITERATOR ====================
+  /**
+   * WordEntry is what a WordIterator yields: the word spelled so far (valid
+   * until the iterator advances) and the node that terminates it.
+   */
+  struct WordEntry {
+    const string &word;
+    const TrieNode &node;
+  };
+
+  /**
+   * WordIterator is a forward iterator over (word, node) pairs below a
+   * prefix node, in lexicographic order. It keeps an explicit stack of
+   * (node, child cursor) frames and one shared word buffer, so traversal
+   * depth is bounded by heap memory rather than the call stack.
+   * Increment: O(1) amortized per visited node
+   */
+  class WordIterator {
+  public:
+    using iterator_category = forward_iterator_tag;
+    using value_type = WordEntry;
+    using difference_type = ptrdiff_t;
+    using pointer = void;
+    using reference = WordEntry;
+
+    WordIterator() : trie(nullptr), visited(0) {}
+    WordIterator(const Trie *owner, uint32_t start, string prefix)
+        : trie(owner), buffer(move(prefix)), visited(0) {
+      if (start == NO_NODE)
+        return;
+      stack.push_back({start, 0});
+      visited++;
+      if (!trie->nodes[start].isEndOfWord)
+        advance();
+    }
+
+    WordEntry operator*() const {
+      return {buffer, trie->nodes[stack.back().node]};
+    }
+
+    WordIterator &operator++() {
+      advance();
+      return *this;
+    }
+    WordIterator operator++(int) {
+      WordIterator previous = *this;
+      advance();
+      return previous;
+    }
+
+    bool operator==(const WordIterator &other) const {
+      if (stack.empty() || other.stack.empty())
+        return stack.empty() == other.stack.empty();
+      return trie == other.trie && stack.size() == other.stack.size() &&
+             stack.back().node == other.stack.back().node;
+    }
+    bool operator!=(const WordIterator &other) const {
+      return !(*this == other);
+    }
+
+    /** Nodes entered so far, including the start node */
+    size_t nodesVisited() const { return visited; }
+
+  private:
+    struct Frame {
+      uint32_t node;
+      uint16_t cursor;
+    };
+
+    const Trie *trie;
+    vector<Frame> stack;
+    string buffer;
+    size_t visited;
+
+    void advance() {
+      while (!stack.empty()) {
+        Frame &top = stack.back();
+        char label;
+        uint32_t child;
+        if (trie->nextChild(trie->nodes[top.node], top.cursor, label, child)) {
+          buffer.push_back(label);
+          stack.push_back({child, 0});
+          visited++;
+          // The first grandchild is read on the next step; its siblings
+          // only after that subtree, so their loads can overlap it
+          const TrieNode &entered = trie->nodes[child];
+          if (!entered.isWide()) {
+            for (uint16_t i = 1; i < entered.childCount; i++)
+              TRIE_PREFETCH(&trie->nodes[entered.slots[i]]);
+          }
+          if (entered.isEndOfWord)
+            return;
+        } else {
+          stack.pop_back();
+          if (!stack.empty())
+            buffer.pop_back();
+        }
+      }
+    }
+  };
+
+  /**
+   * WordRange adapts a prefix walk for range-based for loops
+   */
+  class WordRange {
+  public:
+    WordRange(WordIterator begin) : first(move(begin)) {}
+    WordIterator begin() const { return first; }
+    WordIterator end() const { return WordIterator(); }
+
+  private:
+    WordIterator first;
+  };
+
+  /**
+   * Iterate all words starting with prefix, in sorted order
+   * Time: O(L) to position, then O(1) amortized per visited node
+   */
+  WordRange words(string_view prefix) const {
+    uint32_t prefixNode = locate(prefix);
+    return WordRange(WordIterator(
+        this, prefixNode,
+        prefixNode == NO_NODE ? string() : normalizer.normalize(prefix)));
+  }
+
+  /**
+   * Stream suggestions for prefix to visit(const string &word) in sorted
+   * order without materialising a result vector. The word reference is only
+   * valid during the call; visit returns false to stop early.
+   * Time: O(L + V) where V = nodes visited to produce offset + limit words
+   */
+  template <typename Visitor>
+  void forEachSuggestion(string_view prefix, Visitor &&visit,
+                         size_t limit = NO_LIMIT, size_t offset = 0) const {
+    ScopedTimer timer(latencyFor(TrieMetrics::SUGGEST));
+    uint32_t prefixNode = locate(prefix);
+    if (!metrics) {
+      if (prefixNode != NO_NODE)
+        emitSuggestions(prefixNode, normalizer.normalize(prefix), visit,
+                        limit, offset);
+      return;
+    }
+    size_t delivered = 0;
+    auto counted = [&](const string &word) {
+      delivered++;
+      return visit(word);
+    };
+    size_t visited = 0;
+    if (prefixNode != NO_NODE)
+      visited = emitSuggestions(prefixNode, normalizer.normalize(prefix),
+                                counted, limit, offset);
+    metrics->nodesVisited.record(visited);
+    metrics->resultSize.record(delivered);
+  }
+
+  /**
+   * Get up to limit sorted suggestions for prefix, starting after the first
+   * offset matches. Children are walked in label order, so no sort is
+   * needed and the walk stops as soon as the page is full.
+   * Time: O(L + V) where V = nodes visited to produce offset + limit words
+   */
+  vector<string> getSuggestions(string_view prefix, size_t limit = NO_LIMIT,
+                                size_t offset = 0) const {
+    vector<string> results;
+    auto collect = [&](const string &word) {
+      results.push_back(word);
+      return true;
+    };
+    if (!cache) {
+      forEachSuggestion(prefix, collect, limit, offset);
+      return results;
+    }
+    ScopedTimer timer(latencyFor(TrieMetrics::SUGGEST));
+    vector<string> page;
+    size_t visited = 0;
+    auto record = [&](const vector<string> &served) {
+      if (metrics) {
+        metrics->nodesVisited.record(visited);
+        metrics->resultSize.record(served.size());
+      }
+    };
+    string cleanPrefix = normalizer.normalize(prefix);
+    if (cache->lookup(cleanPrefix, limit, offset, results)) {
+      record(results);
+      return results;
+    }
+
+    uint32_t prefixNode = searchPrefix(cleanPrefix);
+
+    // Fill one window (plus a probe word to learn whether it is complete)
+    // for the cache, then serve the request from it when it fits.
+    size_t window = cache->window();
+    visited = emitSuggestions(prefixNode, cleanPrefix, collect, window + 1, 0);
+    bool complete = results.size() <= window;
+    if (!complete)
+      results.pop_back();
+    if (complete || (limit <= window && offset <= window - limit)) {
+      size_t first = min(offset, results.size());
+      size_t last = limit >= results.size() - first ? results.size()
+                                                    : first + limit;
+      page.assign(results.begin() + first, results.begin() + last);
+    } else {
+      auto collectPage = [&](const string &word) {
+        page.push_back(word);
+        return true;
+      };
+      visited +=
+          emitSuggestions(prefixNode, cleanPrefix, collectPage, limit, offset);
+    }
+    cache->store(cleanPrefix, move(results), complete);
+    record(page);
+    return page;
+  }
+
+  /**
+   * Answer many prefix queries at once; results[i] matches prefixes[i].
+   * Queries are sorted by normalized prefix and cut into blocks; within a
+   * block each descent resumes from the previous prefix's node path at
+   * their common stem, and repeated prefixes reuse the previous answer.
+   * Blocks run on pool when one is given.
+   * Time: O(Q log Q + sum of unshared prefix chars + results)
+   */
+  vector<vector<string>> getSuggestionsBatch(const vector<string> &prefixes,
+                                             size_t limit = NO_LIMIT,
+                                             ThreadPool *pool = nullptr) const {
+    static constexpr size_t BLOCK = 64;
+    vector<string> keys(prefixes.size());
+    vector<size_t> order(prefixes.size());
+    for (size_t i = 0; i < prefixes.size(); i++) {
+      keys[i] = normalizer.normalize(prefixes[i]);
+      order[i] = i;
+    }
+    sort(order.begin(), order.end(),
+         [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+
+    vector<vector<string>> results(prefixes.size());
+    auto runBlock = [&](size_t block) {
+      size_t first = block * BLOCK;
+      size_t last = min(first + BLOCK, order.size());
+      vector<uint32_t> path{ROOT};
+      const string *previous = nullptr;
+      for (size_t i = first; i < last; i++) {
+        const string &key = keys[order[i]];
+        vector<string> &out = results[order[i]];
+        if (previous && key == *previous) {
+          out = results[order[i - 1]];
+          continue;
+        }
+        size_t common = 0;
+        if (previous) {
+          size_t bound = min(key.size(), path.size() - 1);
+          while (common < bound && key[common] == (*previous)[common])
+            common++;
+        }
+        path.resize(common + 1);
+        uint32_t node = descend(key, common, path);
+        auto collect = [&](const string &word) {
+          out.push_back(word);
+          return true;
+        };
+        emitSuggestions(node, key, collect, limit, 0);
+        previous = &key;
+      }
+    };
+
+    size_t blocks = (order.size() + BLOCK - 1) / BLOCK;
+    if (pool)
+      pool->parallelFor(blocks, runBlock);
+    else
+      for (size_t b = 0; b < blocks; b++)
+        runBlock(b);
+    return results;
+  }
+
+  /**
+   * Get the k highest-weighted words under prefix, best first; equal
+   * weights are ordered alphabetically. Best-first search over maxWeight
+   * bounds expands only nodes that can still beat the k-th result.
+   * Time: O(L + k*F*log(k*F)) where F = avg fan-out, independent of subtree
+   */
+  vector<Suggestion> getTopK(string_view prefix, size_t k) const {
+    ScopedTimer timer(latencyFor(TrieMetrics::TOPK));
+    uint32_t prefixNode = locate(prefix);
+    if (prefixNode == NO_NODE)
+      return {};
+    return bestFirstTopK(
+        prefixNode, nodes[prefixNode].maxWeight, normalizer.normalize(prefix),
+        k,
+        [&](uint32_t index, auto &&pushWord, auto &&pushChild) {
+          const TrieNode &node = nodes[index];
+          if (node.isEndOfWord)
+            pushWord(node.weight);
+          forEachChild(node, [&](char key, uint32_t child) {
+            pushChild(child, key, nodes[child].maxWeight);
+            return true;
+          });
+        });
+  }
+
+  /**
+   * Encode the trie as a flat, position-independent snapshot image that
+   * MappedTrie can mmap directly. Every node's children stay contiguous,
+   * and the image holds only offsets. Sibling groups are placed so that
+   * descents stay inside a few cache lines and pages. A hot top region of
+   * SNAPSHOT_TOP_NODES comes first. Below it, each remaining subtree is
+   * cut into SNAPSHOT_BLOCK_NODES blocks, laid out depth-first so that a
+   * subtree's blocks sit together. Within a region, groups are expanded
+   * hottest first. Heat is the number of hotQueries whose prefix walk
+   * passes through a node; without a profile every node ties, which
+   * makes each region breadth-first.
+   * Time: O(N log N + total query length), Space: O(N) staging
+   */
+  string serializeSnapshot(const vector<string> &hotQueries = {}) const {
+    static constexpr size_t SNAPSHOT_TOP_NODES = 4096;
+    static constexpr size_t SNAPSHOT_BLOCK_NODES = 256;
+
+    vector<uint32_t> heat;
+    if (!hotQueries.empty()) {
+      heat.assign(nodes.size(), 0);
+      for (const string &query : hotQueries) {
+        uint32_t current = ROOT;
+        for (char byte : normalizer.trimmed(query)) {
+          unsigned char ch = normalizer.map(byte);
+          if (ch == 0)
+            continue;
+          if ((current = findChild(nodes[current], ch)) == NO_NODE)
+            break;
+          heat[current]++;
+        }
+      }
+    }
+
+    // order maps new ids to pool indices; ids are handed out group by
+    // group, so a lower id also means discovered earlier
+    vector<uint32_t> order{ROOT};
+    vector<SnapshotNode> flat(1);
+    vector<unsigned char> edgeLabels{0};
+    flat.reserve(nodes.size());
+    edgeLabels.reserve(nodes.size());
+    auto hotter = [&](uint32_t a, uint32_t b) {
+      uint32_t heatA = heat.empty() ? 0 : heat[order[a]];
+      uint32_t heatB = heat.empty() ? 0 : heat[order[b]];
+      return heatA != heatB ? heatA < heatB : a > b;
+    };
+    auto placeChildren = [&](uint32_t id) {
+      const TrieNode &node = nodes[order[id]];
+      flat[id].firstChild = static_cast<uint32_t>(order.size());
+      forEachChild(node, [&](char key, uint32_t child) {
+        order.push_back(child);
+        flat.emplace_back();
+        edgeLabels.push_back(static_cast<unsigned char>(key));
+        return true;
+      });
+    };
+
+    // Each pending entry roots a region still to be laid out
+    vector<pair<uint32_t, size_t>> pending{{0, SNAPSHOT_TOP_NODES}};
+    vector<uint32_t> frontier;
+    while (!pending.empty()) {
+      auto [seed, budget] = pending.back();
+      pending.pop_back();
+      priority_queue<uint32_t, vector<uint32_t>, decltype(hotter)> open(
+          hotter);
+      open.push(seed);
+      for (size_t placed = 0; !open.empty() && placed < budget;) {
+        uint32_t id = open.top();
+        open.pop();
+        size_t first = order.size();
+        placeChildren(id);
+        placed += order.size() - first;
+        for (size_t child = first; child < order.size(); child++) {
+          if (nodes[order[child]].childCount > 0)
+            open.push(static_cast<uint32_t>(child));
+        }
+      }
+      // Leftover subtrees become blocks, hottest laid out next
+      frontier.clear();
+      for (; !open.empty(); open.pop())
+        frontier.push_back(open.top());
+      for (auto it = frontier.rbegin(); it != frontier.rend(); ++it)
+        pending.push_back({*it, SNAPSHOT_BLOCK_NODES});
+    }
+
+    for (size_t id = 0; id < order.size(); id++) {
+      const TrieNode &node = nodes[order[id]];
+      SnapshotNode &out = flat[id];
+      if (node.childCount == 0)
+        out.firstChild = static_cast<uint32_t>(order.size());
+      out.childCount = node.childCount;
+      out.isEndOfWord = node.isEndOfWord;
+      out.weight = node.weight;
+      out.maxWeight = node.maxWeight;
+    }
+
+    SnapshotHeader header{};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.nodeCount = static_cast<uint32_t>(flat.size());
+    header.wordCount = static_cast<uint32_t>(wordCount);
+    memcpy(header.keyTable, normalizer.mapping().data(),
+           sizeof(header.keyTable));
+    header.nodesOffset = sizeof(SnapshotHeader);
+    header.labelsOffset = header.nodesOffset + flat.size() * sizeof(SnapshotNode);
+
+    string image;
+    image.reserve(header.labelsOffset + edgeLabels.size());
+    image.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    image.append(reinterpret_cast<const char *>(flat.data()),
+                 flat.size() * sizeof(SnapshotNode));
+    image.append(reinterpret_cast<const char *>(edgeLabels.data()),
+                 edgeLabels.size());
+    return image;
+  }
+
+  /**
+   * Write serializeSnapshot(hotQueries) to filePath
+   */
+  bool saveSnapshot(const string &filePath,
+                    const vector<string> &hotQueries = {}) const {
+    string image = serializeSnapshot(hotQueries);
+    ofstream out(filePath, ios::binary | ios::trunc);
+    if (!out)
+      return false;
+    out.write(image.data(), static_cast<streamsize>(image.size()));
+    return static_cast<bool>(out.flush());
+  }
+
+  /**
+   * Build the read-only succinct form of this trie. Nodes are renumbered in
+   * level order, as in saveSnapshot, and each one costs a few bits of shape
+   * plus its label and quantized top-K bound.
+   * Time: O(N), Space: O(N) staging for the level order
+   */
+  FrozenTrie freeze() const {
+    FrozenTrie frozen(normalizer);
+    frozen.labels.reserve(nodes.liveCount());
+    frozen.bounds.reserve(nodes.liveCount());
+    frozen.weights.reserve(wordCount);
+
+    vector<uint32_t> order{ROOT};
+    frozen.labels.push_back(0);
+    for (size_t i = 0; i < order.size(); i++) {
+      const TrieNode &node = nodes[order[i]];
+      frozen.bounds.push_back(FrozenTrie::quantize(node.maxWeight));
+      frozen.terminal.push(node.isEndOfWord);
+      if (node.isEndOfWord)
+        frozen.weights.push_back(node.weight);
+      forEachChild(node, [&](char key, uint32_t child) {
+        order.push_back(child);
+        frozen.labels.push_back(static_cast<unsigned char>(key));
+        frozen.louds.push(true);
+        return true;
+      });
+      frozen.louds.push(false);
+    }
+    frozen.louds.finish();
+    frozen.terminal.finish();
+    frozen.nodeCount = static_cast<uint32_t>(order.size());
+    return frozen;
+  }
+
+  /**
+   * Remove word from Trie. Nodes left with no children and no word are
+   * pruned bottom-up and returned to the pool, and maxWeight is recomputed
+   * along the surviving path so top-K bounds stay tight.
+   * Returns false if word was not present.
+   * Time: O(L * fan-out) worst case
+   */
+  bool remove(string_view word) {
+    ScopedTimer timer(latencyFor(TrieMetrics::REMOVE));
+    normalizer.normalize(word, scratchKey);
+    const string &key = scratchKey;
+    vector<uint32_t> &path = scratchPath;
+    if (key.empty())
+      return false;
+    path.assign(1, ROOT);
+    uint32_t node = descend(key, 0, path);
+    if (node == NO_NODE || !nodes[node].isEndOfWord)
+      return false;
+    nodes[node].isEndOfWord = false;
+    nodes[node].weight = 0;
+    wordCount--;
+
+    size_t depth = key.size();
+    while (depth > 0 && nodes[path[depth]].childCount == 0 &&
+           !nodes[path[depth]].isEndOfWord) {
+      removeChild(nodes[path[depth - 1]],
+                  static_cast<unsigned char>(key[depth - 1]));
+      nodes.release(path[depth]);
+      depth--;
+    }
+    // Ancestors depend only on their children's bounds, so stop as soon as
+    // one node's bound is unchanged
+    for (size_t i = depth + 1; i-- > 0;) {
+      TrieNode &current = nodes[path[i]];
+      uint32_t bound = subtreeMaxWeight(current);
+      if (bound == current.maxWeight)
+        break;
+      current.maxWeight = bound;
+    }
+
+    version++;
+    if (cache)
+      cache->invalidatePrefixes(key);
+    return true;
+  }
+
+  int getWordCount() const { return wordCount; }
+  uint32_t getNodeCount() const { return nodes.liveCount(); }
+
+  /**
+   * Bytes held by the node arena and wide child tables (the result cache,
+   * if enabled, is not counted) - Time: O(wide nodes)
+   */
+  size_t getMemoryUsage() const {
+    size_t bytes = nodes.memoryUsage() +
+                   wideChildren.capacity() * sizeof(WideChildren) +
+                   freeWide.capacity() * sizeof(uint32_t);
+    for (const WideChildren &wide : wideChildren)
+      bytes += wide.children.capacity() * sizeof(uint32_t);
+    return bytes;
+  }
+
+  /**
+   * Get words that start with some string within maxEdits Levenshtein
+   * edits (insert, delete, substitute) of prefix, in sorted order. The
+   * bound is silently capped at |normalized prefix| - 1, so short prefixes
+   * are not "matched" by editing them away entirely; callers that expose
+   * maxEdits should document the cap. Rows of
+   * the edit-distance table are computed incrementally per trie edge, so
+   * shared stems are scored once and hopeless subtrees are pruned early.
+   * Time: O(E * L) where E = trie edges within the edit bound, plus results
+   */
+  vector<string> getFuzzySuggestions(string_view prefix, size_t maxEdits,
+                                     size_t limit = NO_LIMIT) const {
+    ScopedTimer timer(latencyFor(TrieMetrics::FUZZY));
+    vector<string> results;
+    if (limit == 0)
+      return results;
+    string query = normalizer.normalize(prefix);
+    // A stem must keep at least one query character: at distance
+    // |query| even the empty stem matches and every word would qualify
+    if (query.empty())
+      return results;
+    maxEdits = min(maxEdits, query.size() - 1);
+    vector<vector<size_t>> rows(1, vector<size_t>(query.size() + 1));
+    for (size_t j = 0; j <= query.size(); j++)
+      rows[0][j] = j;
+    string buffer;
+    auto collect = [&](const string &word) {
+      results.push_back(word);
+      return true;
+    };
+    fuzzyWalk(ROOT, query, maxEdits, rows, buffer, collect, limit);
+    return results;
+  }
+
+  /**
+   * Put a bounded LRU of result pages in front of getSuggestions. capacity
+   * is the number of cached prefixes; window is how many suggestions each
+   * entry keeps. Inserting a new word invalidates only its prefix chain.
+   */
+  void enableCache(size_t capacity, size_t window = 64) {
+    cache = make_unique<SuggestionCache>(capacity, window);
+  }
+
+  bool hasCache() const { return cache != nullptr; }
+
+  /**
+   * Start recording TrieMetrics; until then instrumented calls pay one
+   * null check and no clock reads
+   */
+  void enableMetrics() {
+    if (!metrics)
+      metrics = make_unique<TrieMetrics>();
+  }
+
+  const TrieMetrics *getMetrics() const { return metrics.get(); }
+
+  /**
+   * Node count, memory, depth and fan-out from maintained counters
+   * Time: O(wide nodes) for the memory figure
+   */
+  ShapeStats getShapeStats() const {
+    return {getNodeCount(), getMemoryUsage(), maxDepth,
+            internalNodes ? double(getNodeCount() - 1) / internalNodes : 0.0};
+  }
+
+  CacheStats getCacheStats() const {
+    return cache ? cache->stats() : CacheStats{0, 0, 0, 0};
+  }
+
+  /**
+   * Modification counter, bumped by every insert; lets cached views such
+   * as SuggestSession detect that they are stale
+   */
+  uint64_t getVersion() const { return version; }
+
+  const KeyNormalizer &getNormalizer() const { return normalizer; }
+};
+
+// ==================== SUGGEST SESSION ====================
+/**
+ * SuggestSession follows one user typing a prefix a keystroke at a time.
+ * It keeps the trie node for every prefix length, so push()/pop() cost one
+ * child step instead of a descent from the root, and caches each length's
+ * result page. When a longer prefix is requested and a shorter one's
+ * complete result set is cached, the answer is the contiguous matching
+ * range of that sorted list and the trie is not walked at all. Keystrokes
+ * go through the trie's KeyNormalizer but are not trimmed; one it drops
+ * (a dash under letters(), say) adds no frame, as getSuggestions skips it.
+ */
+class SuggestSession {
+private:
+  static constexpr uint32_t NO_NODE = numeric_limits<uint32_t>::max();
+
+  struct Frame {
+    uint32_t node;
+    bool cached;
+    bool complete;
+    vector<string> results;
+  };
+
+  const Trie &trie;
+  size_t limit;
+  uint64_t version;
+  string typed;   // Raw keystrokes, so pop() knows which ones were kept
+  string current; // Their normalized key, one frame per byte past ROOT
+  vector<Frame> frames;
+
+  uint32_t step(uint32_t node, char ch) const {
+    return node == NO_NODE
+               ? NO_NODE
+               : trie.findChild(trie.nodes[node], static_cast<unsigned char>(ch));
+  }
+
+  /**
+   * Re-descend after the trie changed underneath the session
+   */
+  void refresh() {
+    if (version == trie.getVersion())
+      return;
+    version = trie.getVersion();
+    frames.assign(1, {Trie::ROOT, false, false, {}});
+    for (char ch : current)
+      frames.push_back({step(frames.back().node, ch), false, false, {}});
+  }
+
+public:
+  SuggestSession(const Trie &source, size_t pageLimit = Trie::NO_LIMIT)
+      : trie(source), limit(pageLimit), version(source.getVersion()) {
+    frames.push_back({Trie::ROOT, false, false, {}});
+  }
+
+  /**
+   * Extend the prefix by one keystroke - Time: O(1)
+   */
+  void push(char ch) {
+    refresh();
+    typed.push_back(ch);
+    unsigned char mapped = trie.normalizer.map(ch);
+    if (mapped == 0)
+      return;
+    current.push_back(static_cast<char>(mapped));
+    frames.push_back({step(frames.back().node, current.back()), false, false,
+                      {}});
+  }
+
+  /**
+   * Drop the last keystroke; the shorter prefix's cached page is reused
+   * Time: O(1)
+   */
+  void pop() {
+    if (typed.empty())
+      return;
+    bool kept = trie.normalizer.map(typed.back()) != 0;
+    typed.pop_back();
+    if (kept) {
+      current.pop_back();
+      frames.pop_back();
+    }
+  }
+
+  void reset() {
+    typed.clear();
+    current.clear();
+    frames.resize(1);
+  }
+
+  const string &prefix() const { return current; }
+
+  /**
+   * Suggestions for the current prefix, cached per prefix length
+   * Time: O(1) when cached, O(log K + results) when narrowing a complete
+   * cached set, otherwise one traversal from the current node
+   */
+  const vector<string> &suggestions() {
+    refresh();
+    Frame &top = frames.back();
+    if (top.cached)
+      return top.results;
+
+    top.cached = true;
+    top.complete = true;
+    if (top.node == NO_NODE || limit == 0)
+      return top.results;
+
+    for (size_t depth = frames.size() - 1; depth-- > 0;) {
+      const Frame &shorter = frames[depth];
+      if (!shorter.cached || !shorter.complete)
+        continue;
+      auto it = lower_bound(shorter.results.begin(), shorter.results.end(),
+                            current);
+      for (; it != shorter.results.end() &&
+             it->compare(0, current.size(), current) == 0;
+           ++it) {
+        if (top.results.size() == limit) {
+          top.complete = false;
+          break;
+        }
+        top.results.push_back(*it);
+      }
+      return top.results;
+    }
+
+    auto collect = [&](const string &word) {
+      top.results.push_back(word);
+      return true;
+    };
+    trie.emitSuggestions(top.node, current, collect, limit, 0);
+    top.complete = top.results.size() < limit;
+    return top.results;
+  }
+};
+
+// ==================== READER GATE ====================
+/**
+ * ReaderGate tracks in-flight readers so a writer can wait out a grace
+ * period before reusing memory they might still see (an RCU-style
+ * "synchronize"). Readers only bump a per-shard, per-epoch counter, so they
+ * never block; the writer flips the epoch twice and waits for each parity
+ * to drain, which covers readers that raced with either flip.
+ */
+class ReaderGate {
+private:
+  static constexpr size_t SHARDS = 16;
+
+  struct alignas(64) Shard {
+    atomic<int64_t> active[2];
+    Shard() : active{{0}, {0}} {}
+  };
+
+  Shard shards[SHARDS];
+  atomic<uint64_t> epoch;
+
+  static size_t shardIndex() {
+    static thread_local size_t index =
+        hash<thread::id>()(this_thread::get_id()) % SHARDS;
+    return index;
+  }
+
+  void drain(uint64_t parity) const {
+    while (true) {
+      int64_t total = 0;
+      for (const Shard &shard : shards)
+        total += shard.active[parity].load();
+      if (total == 0)
+        return;
+      this_thread::yield();
+    }
+  }
+
+public:
+  ReaderGate() : epoch(0) {}
+
+  /**
+   * Ticket returned by enter(); pass it back to leave()
+   */
+  struct Ticket {
+    size_t shard;
+    uint64_t parity;
+  };
+
+  Ticket enter() {
+    Ticket ticket{shardIndex(), epoch.load() & 1};
+    shards[ticket.shard].active[ticket.parity].fetch_add(1);
+    return ticket;
+  }
+
+  void leave(Ticket ticket) {
+    shards[ticket.shard].active[ticket.parity].fetch_sub(1);
+  }
+
+  /**
+   * Block the calling writer until every reader that entered before this
+   * call has left
+   */
+  void synchronize() {
+    for (int phase = 0; phase < 2; phase++)
+      drain(epoch.fetch_add(1) & 1);
+  }
+};
+
+// ==================== CONCURRENT TRIE ====================
+/**
+ * ConcurrentTrie lets many query threads read while one ingest thread
+ * inserts and removes words. It keeps two Trie replicas (a left-right
+ * scheme): readers use the published replica without locks, the writer
+ * mutates the other one, and publish() swaps them, waits a ReaderGate
+ * grace period, then replays the batch onto the replica readers just
+ * left. Publishing costs O(batch) work instead of a full copy, and reads
+ * never wait on the writer.
+ */
+class ConcurrentTrie {
+private:
+  struct PendingOp {
+    string word;
+    uint32_t weight;
+    bool removal;
+  };
+
+  Trie replicas[2];
+  atomic<int> front;
+  mutable ReaderGate gate;
+  mutex writerMutex;
+  vector<PendingOp> pending;
+  size_t publishEvery;
+
+  template <typename Query> auto read(Query &&query) const {
+    ReaderGate::Ticket ticket = gate.enter();
+    const Trie &trie = replicas[front.load()];
+    struct Exit {
+      ReaderGate &gate;
+      ReaderGate::Ticket ticket;
+      ~Exit() { gate.leave(ticket); }
+    } exit{gate, ticket};
+    return query(trie);
+  }
+
+  void publishLocked() {
+    if (pending.empty())
+      return;
+    int back = 1 - front.load();
+    front.store(back);
+    gate.synchronize();
+    for (const PendingOp &op : pending) {
+      if (op.removal)
+        replicas[1 - back].remove(op.word);
+      else
+        replicas[1 - back].insert(op.word, op.weight);
+    }
+    pending.clear();
+  }
+
+public:
+  /**
+   * publishAfter bounds how many writes may be buffered before they are
+   * made visible automatically; 1 publishes on every insert
+   */
+  explicit ConcurrentTrie(size_t publishAfter = 1024,
+                          const KeyNormalizer &keys = KeyNormalizer::letters())
+      : replicas{Trie(keys), Trie(keys)}, front(0),
+        publishEvery(max<size_t>(publishAfter, 1)) {}
+
+  /**
+   * Writer: insert into the unpublished replica - Time: O(L)
+   */
+  void insert(string_view word, uint32_t weight = 1) {
+    lock_guard<mutex> lock(writerMutex);
+    replicas[1 - front.load()].insert(word, weight);
+    pending.push_back({string(word), weight, false});
+    if (pending.size() >= publishEvery)
+      publishLocked();
+  }
+
+  /**
+   * Writer: remove from the unpublished replica; the removal becomes
+   * visible to readers on the next publish - Time: O(L * fan-out)
+   */
+  bool remove(string_view word) {
+    lock_guard<mutex> lock(writerMutex);
+    bool removed = replicas[1 - front.load()].remove(word);
+    if (removed) {
+      pending.push_back({string(word), 0, true});
+      if (pending.size() >= publishEvery)
+        publishLocked();
+    }
+    return removed;
+  }
+
+  /**
+   * Writer: make all buffered writes visible to readers
+   * Time: O(batch * L) plus one reader grace period
+   */
+  void publish() {
+    lock_guard<mutex> lock(writerMutex);
+    publishLocked();
+  }
+
+  vector<string> getSuggestions(string_view prefix,
+                                size_t limit = Trie::NO_LIMIT,
+                                size_t offset = 0) const {
+    return read([&](const Trie &trie) {
+      return trie.getSuggestions(prefix, limit, offset);
+    });
+  }
+
+  vector<Suggestion> getTopK(string_view prefix, size_t k) const {
+    return read([&](const Trie &trie) { return trie.getTopK(prefix, k); });
+  }
+
+  int getWordCount() const {
+    return read([](const Trie &trie) { return trie.getWordCount(); });
+  }
+};
+
+// ==================== RADIX TRIE ====================
+/**
+ * RadixNode is a path-compressed node: the edge leading into it carries a
+ * multi-character label stored as an (offset, length) slice of the owning
+ * RadixTrie's label buffer. Siblings form a list sorted by first label byte.
+ */
+struct RadixNode {
+  uint32_t labelOffset;
+  uint32_t labelLength;
+  uint32_t firstChild;
+  uint32_t nextSibling;
+  bool isEndOfWord;
+  RadixNode()
+      : labelOffset(0), labelLength(0),
+        firstChild(numeric_limits<uint32_t>::max()),
+        nextSibling(numeric_limits<uint32_t>::max()), isEndOfWord(false) {}
+};
+
+/**
+ * RadixTrie is a Patricia (path-compressed) variant of Trie with the same
+ * insert/getSuggestions API. Single-child chains collapse into one edge, so
+ * node count and dependent loads per lookup scale with branch points rather
+ * than characters.
+ */
+class RadixTrie {
+private:
+  static constexpr uint32_t ROOT = 0;
+  static constexpr uint32_t NO_NODE = numeric_limits<uint32_t>::max();
+
+  NodePool<RadixNode> nodes;
+  string labels;
+  KeyNormalizer normalizer;
+  int wordCount;
+
+  /**
+   * Find child of node whose edge label starts with ch; prev receives the
+   * sibling after which a new child with that first byte would be linked.
+   * Time Complexity: O(fan-out)
+   */
+  uint32_t findChild(uint32_t node, unsigned char ch, uint32_t &prev) const {
+    prev = NO_NODE;
+    for (uint32_t child = nodes[node].firstChild; child != NO_NODE;
+         child = nodes[child].nextSibling) {
+      unsigned char first = labels[nodes[child].labelOffset];
+      if (first == ch)
+        return child;
+      if (first > ch)
+        break;
+      prev = child;
+    }
+    return NO_NODE;
+  }
+
+  void linkAfter(uint32_t parent, uint32_t prev, uint32_t child) {
+    if (prev == NO_NODE) {
+      nodes[child].nextSibling = nodes[parent].firstChild;
+      nodes[parent].firstChild = child;
+    } else {
+      nodes[child].nextSibling = nodes[prev].nextSibling;
+      nodes[prev].nextSibling = child;
+    }
+  }
+
+  /**
+   * Collect words below node in lexicographic order, honouring skip/limit
+   * like Trie::forEachSuggestion. Uses an explicit stack of pending
+   * siblings so deep keys cannot overflow the call stack; siblings are
+   * sorted by first byte, so DFS order is already lexicographic.
+   * Time Complexity: O(V) where V = nodes visited up to the limit
+   */
+  void collectSuggestions(uint32_t node, string &currentPrefix,
+                          vector<string> &results, size_t &skip,
+                          size_t limit) const {
+    // Each frame is the next child to visit and the buffer length its
+    // label should be appended at.
+    vector<pair<uint32_t, size_t>> stack;
+    uint32_t current = node;
+    while (true) {
+      if (nodes[current].isEndOfWord) {
+        if (skip > 0)
+          skip--;
+        else
+          results.push_back(currentPrefix);
+        if (results.size() >= limit)
+          return;
+      }
+      size_t base = currentPrefix.size();
+      uint32_t next = nodes[current].firstChild;
+      if (current != node && nodes[current].nextSibling != NO_NODE)
+        stack.push_back({nodes[current].nextSibling,
+                         base - nodes[current].labelLength});
+      if (next == NO_NODE) {
+        if (stack.empty())
+          return;
+        tie(next, base) = stack.back();
+        stack.pop_back();
+      }
+      currentPrefix.resize(base);
+      currentPrefix.append(labels, nodes[next].labelOffset,
+                           nodes[next].labelLength);
+      current = next;
+    }
+  }
+
+  /**
+   * Find the node whose path covers prefix. The prefix may end inside an
+   * edge label; path receives the full string spelled out to that node.
+   * Time Complexity: O(L) character compares, O(edges) dependent loads
+   */
+  uint32_t searchPrefix(const string &prefix, string &path) const {
+    uint32_t current = ROOT;
+    size_t pos = 0;
+    while (pos < prefix.size()) {
+      uint32_t prev;
+      uint32_t child =
+          findChild(current, static_cast<unsigned char>(prefix[pos]), prev);
+      if (child == NO_NODE)
+        return NO_NODE;
+      const RadixNode &edge = nodes[child];
+      size_t n = min<size_t>(edge.labelLength, prefix.size() - pos);
+      if (labels.compare(edge.labelOffset, n, prefix, pos, n) != 0)
+        return NO_NODE;
+      path.append(labels, edge.labelOffset, edge.labelLength);
+      pos += n;
+      current = child;
+    }
+    return current;
+  }
+
+public:
+  explicit RadixTrie(const KeyNormalizer &keys = KeyNormalizer::letters())
+      : normalizer(keys), wordCount(0) {
+    nodes.allocate();
+  }
+
+  /**
+   * Insert word, splitting at most one edge - Time: O(L)
+   */
+  void insert(string_view word) {
+    string cleanWord;
+    normalizer.normalize(word, cleanWord);
+    if (cleanWord.empty())
+      return;
+
+    uint32_t current = ROOT;
+    size_t pos = 0;
+    while (pos < cleanWord.size()) {
+      uint32_t prev;
+      uint32_t child = findChild(
+          current, static_cast<unsigned char>(cleanWord[pos]), prev);
+      if (child == NO_NODE) {
+        uint32_t leaf = nodes.allocate();
+        nodes[leaf].labelOffset = static_cast<uint32_t>(labels.size());
+        nodes[leaf].labelLength = static_cast<uint32_t>(cleanWord.size() - pos);
+        labels.append(cleanWord, pos, string::npos);
+        linkAfter(current, prev, leaf);
+        current = leaf;
+        break;
+      }
+
+      RadixNode &edge = nodes[child];
+      uint32_t common = 0;
+      while (common < edge.labelLength && pos + common < cleanWord.size() &&
+             labels[edge.labelOffset + common] == cleanWord[pos + common])
+        common++;
+
+      if (common < edge.labelLength) {
+        // Split the edge: a new node takes the shared head of the label and
+        // the existing child keeps the tail.
+        uint32_t mid = nodes.allocate();
+        RadixNode &head = nodes[mid];
+        head.labelOffset = edge.labelOffset;
+        head.labelLength = common;
+        head.firstChild = child;
+        head.nextSibling = edge.nextSibling;
+        if (prev == NO_NODE)
+          nodes[current].firstChild = mid;
+        else
+          nodes[prev].nextSibling = mid;
+        edge.labelOffset += common;
+        edge.labelLength -= common;
+        edge.nextSibling = NO_NODE;
+        child = mid;
+      }
+      pos += common;
+      current = child;
+    }
+    if (!nodes[current].isEndOfWord) {
+      nodes[current].isEndOfWord = true;
+      wordCount++;
+    }
+  }
+
+  /**
+   * Check whether word is stored: the descent must end exactly at a node
+   * boundary rather than inside an edge label - Time: O(L)
+   */
+  bool contains(string_view word) const {
+    string cleanWord = normalizer.normalize(word);
+    string path;
+    uint32_t node = searchPrefix(cleanWord, path);
+    return node != NO_NODE && path.size() == cleanWord.size() &&
+           nodes[node].isEndOfWord;
+  }
+
+  /**
+   * Get up to limit sorted suggestions for prefix after skipping offset
+   * Time: O(L + V) where V = nodes visited to fill the page
+   */
+  vector<string> getSuggestions(string_view prefix,
+                                size_t limit = Trie::NO_LIMIT,
+                                size_t offset = 0) const {
+    vector<string> results;
+    string cleanPrefix = normalizer.normalize(prefix);
+    string path;
+    uint32_t prefixNode = searchPrefix(cleanPrefix, path);
+    if (prefixNode == NO_NODE || limit == 0)
+      return results;
+    collectSuggestions(prefixNode, path, results, offset, limit);
+    return results;
+  }
+
+  int getWordCount() const { return wordCount; }
+  uint32_t getNodeCount() const { return nodes.size(); }
+  size_t getMemoryUsage() const {
+    return nodes.memoryUsage() + labels.capacity();
+  }
+};
+
+// ==================== MAPPED TRIE ====================
+/**
+ * MappedTrie serves queries directly from a snapshot written by
+ * Trie::saveSnapshot. The file is mapped read-only and never deserialized,
+ * and concurrent processes share the same page-cache pages. open() makes
+ * one sequential pass over the node array to reject corrupt files, so a
+ * bad snapshot fails to load instead of reading outside the mapping.
+ */
+class MappedTrie {
+private:
+  static constexpr uint32_t ROOT = 0;
+  static constexpr uint32_t NO_NODE = numeric_limits<uint32_t>::max();
+
+  const char *base;
+  size_t length;
+  const SnapshotNode *nodes;
+  const unsigned char *labels;
+  uint32_t nodeCount;
+  uint32_t wordCount;
+  KeyNormalizer normalizer;
+#ifdef _WIN32
+  vector<char> storage;
+#endif
+
+  void release() {
+#ifndef _WIN32
+    if (base)
+      munmap(const_cast<char *>(base), length);
+#endif
+    base = nullptr;
+    length = 0;
+    nodes = nullptr;
+    labels = nullptr;
+    nodeCount = 0;
+    wordCount = 0;
+  }
+
+  /**
+   * Check every node before queries trust it: each child range must lie
+   * inside the node array, start after its parent (so no walk can loop)
+   * and carry strictly increasing labels, and the end-of-word flags must
+   * add up to the header's word count.
+   * Time: O(nodes)
+   */
+  bool validNodes() const {
+    uint64_t words = 0;
+    for (uint32_t id = 0; id < nodeCount; id++) {
+      const SnapshotNode &node = nodes[id];
+      if (node.isEndOfWord > 1)
+        return false;
+      words += node.isEndOfWord;
+      if (node.childCount == 0)
+        continue;
+      uint64_t end = uint64_t(node.firstChild) + node.childCount;
+      if (node.firstChild <= id || end > nodeCount)
+        return false;
+      for (uint32_t child = node.firstChild + 1; child < end; child++)
+        if (labels[child - 1] >= labels[child])
+          return false;
+    }
+    return words == wordCount;
+  }
+
+  /**
+   * Find child of node labelled ch; labels of siblings are contiguous and
+   * sorted, so findLabel scans them a vector at a time.
+   * Time Complexity: O(F / W)
+   */
+  uint32_t findChild(uint32_t node, unsigned char ch) const {
+    const SnapshotNode &parent = nodes[node];
+    size_t pos = findLabel(labels + parent.firstChild, parent.childCount, ch);
+    return pos == parent.childCount
+               ? NO_NODE
+               : parent.firstChild + static_cast<uint32_t>(pos);
+  }
+
+  /**
+   * Same as Trie::locate: normalize raw while descending, no allocation
+   */
+  uint32_t locate(string_view raw) const {
+    uint32_t current = ROOT;
+    for (char byte : normalizer.trimmed(raw)) {
+      unsigned char ch = normalizer.map(byte);
+      if (ch == 0)
+        continue;
+      current = findChild(current, ch);
+      if (current == NO_NODE)
+        return NO_NODE;
+    }
+    return current;
+  }
+
+public:
+  MappedTrie()
+      : base(nullptr), length(0), nodes(nullptr), labels(nullptr),
+        nodeCount(0), wordCount(0), normalizer(KeyNormalizer::letters()) {}
+  ~MappedTrie() { release(); }
+  MappedTrie(const MappedTrie &) = delete;
+  MappedTrie &operator=(const MappedTrie &) = delete;
+
+  /**
+   * Map a snapshot file; returns false if it is missing or malformed
+   * Time: O(1) - pages are faulted in lazily by queries
+   */
+  bool open(const string &filePath) {
+    release();
+#ifdef _WIN32
+    ifstream in(filePath, ios::binary);
+    if (!in)
+      return false;
+    storage.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+    base = storage.data();
+    length = storage.size();
+#else
+    int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < 0) {
+      ::close(fd);
+      return false;
+    }
+    length = static_cast<size_t>(info.st_size);
+    void *mapped =
+        length ? mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0) : nullptr;
+    ::close(fd);
+    if (mapped == MAP_FAILED || !mapped) {
+      length = 0;
+      return false;
+    }
+    base = static_cast<const char *>(mapped);
+#endif
+
+    SnapshotHeader header;
+    if (length < sizeof(header)) {
+      release();
+      return false;
+    }
+    memcpy(&header, base, sizeof(header));
+    uint64_t nodesEnd =
+        header.nodesOffset + uint64_t(header.nodeCount) * sizeof(SnapshotNode);
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SNAPSHOT_VERSION || header.nodeCount == 0 ||
+        header.nodesOffset % alignof(SnapshotNode) != 0 ||
+        header.nodesOffset < sizeof(header) ||
+        header.nodesOffset > length || header.labelsOffset > length ||
+        nodesEnd > header.labelsOffset ||
+        header.labelsOffset + header.nodeCount != length) {
+      release();
+      return false;
+    }
+    nodes = reinterpret_cast<const SnapshotNode *>(base + header.nodesOffset);
+    labels = reinterpret_cast<const unsigned char *>(base + header.labelsOffset);
+    nodeCount = header.nodeCount;
+    wordCount = header.wordCount;
+    if (!validNodes()) {
+      release();
+      return false;
+    }
+    KeyNormalizer::Table table;
+    memcpy(table.data(), header.keyTable, table.size());
+    normalizer = KeyNormalizer(table);
+    return true;
+  }
+
+  bool isOpen() const { return base != nullptr; }
+
+  bool contains(string_view word) const {
+    if (!isOpen())
+      return false;
+    uint32_t node = locate(word);
+    return node != NO_NODE && nodes[node].isEndOfWord;
+  }
+
+  /**
+   * Stream suggestions in sorted order, same contract as
+   * Trie::forEachSuggestion
+   * Time: O(L + V) where V = nodes visited to fill the page
+   */
+  template <typename Visitor>
+  void forEachSuggestion(string_view prefix, Visitor &&visit,
+                         size_t limit = Trie::NO_LIMIT,
+                         size_t offset = 0) const {
+    if (!isOpen() || limit == 0)
+      return;
+    uint32_t start = locate(prefix);
+    if (start == NO_NODE)
+      return;
+    string buffer = normalizer.normalize(prefix);
+
+    // Frames are (node, next child index); children are contiguous, so a
+    // frame is exhausted when its cursor reaches firstChild + childCount.
+    vector<pair<uint32_t, uint32_t>> stack{{start, nodes[start].firstChild}};
+    auto emit = [&](uint32_t node) {
+      if (!nodes[node].isEndOfWord)
+        return true;
+      if (offset > 0) {
+        offset--;
+        return true;
+      }
+      return visit(static_cast<const string &>(buffer)) && --limit != 0;
+    };
+    if (!emit(start))
+      return;
+    while (!stack.empty()) {
+      auto &[node, cursor] = stack.back();
+      if (cursor == nodes[node].firstChild + nodes[node].childCount) {
+        stack.pop_back();
+        if (!stack.empty())
+          buffer.pop_back();
+        continue;
+      }
+      uint32_t child = cursor++;
+      buffer.push_back(static_cast<char>(labels[child]));
+      stack.push_back({child, nodes[child].firstChild});
+      if (!emit(child))
+        return;
+    }
+  }
+
+  /**
+   * Visit every word with its weight in sorted order, e.g. to thaw the
+   * snapshot back into a Trie with Trie::loadWords
+   * Time: O(N)
+   */
+  template <typename Visitor> void forEachWord(Visitor &&visit) const {
+    if (!isOpen())
+      return;
+    string buffer;
+    vector<pair<uint32_t, uint32_t>> stack{{ROOT, nodes[ROOT].firstChild}};
+    if (nodes[ROOT].isEndOfWord)
+      visit(static_cast<const string &>(buffer), nodes[ROOT].weight);
+    while (!stack.empty()) {
+      auto &[node, cursor] = stack.back();
+      if (cursor == nodes[node].firstChild + nodes[node].childCount) {
+        stack.pop_back();
+        if (!stack.empty())
+          buffer.pop_back();
+        continue;
+      }
+      uint32_t child = cursor++;
+      buffer.push_back(static_cast<char>(labels[child]));
+      stack.push_back({child, nodes[child].firstChild});
+      if (nodes[child].isEndOfWord)
+        visit(static_cast<const string &>(buffer), nodes[child].weight);
+    }
+  }
+
+  vector<string> getSuggestions(string_view prefix,
+                                size_t limit = Trie::NO_LIMIT,
+                                size_t offset = 0) const {
+    vector<string> results;
+    forEachSuggestion(
+        prefix,
+        [&](const string &word) {
+          results.push_back(word);
+          return true;
+        },
+        limit, offset);
+    return results;
+  }
+
+  /**
+   * Same ranking as Trie::getTopK, served from the mapped node array
+   */
+  vector<Suggestion> getTopK(string_view prefix, size_t k) const {
+    if (!isOpen())
+      return {};
+    uint32_t start = locate(prefix);
+    if (start == NO_NODE)
+      return {};
+    return bestFirstTopK(
+        start, nodes[start].maxWeight, normalizer.normalize(prefix), k,
+        [&](uint32_t index, auto &&pushWord, auto &&pushChild) {
+          const SnapshotNode &node = nodes[index];
+          if (node.isEndOfWord)
+            pushWord(node.weight);
+          for (uint32_t c = node.firstChild;
+               c < node.firstChild + node.childCount; c++)
+            pushChild(c, static_cast<char>(labels[c]), nodes[c].maxWeight);
+        });
+  }
+
+  int getWordCount() const { return static_cast<int>(wordCount); }
+  uint32_t getNodeCount() const { return nodeCount; }
+  size_t getMemoryUsage() const { return length; }
+};
+
+// ==================== DAWG ====================
+/**
+ * Dawg is a minimal deterministic acyclic word graph: a trie in which
+ * equivalent subtrees (same end-of-word flag and the same labelled edges
+ * to the same states) are stored once, so shared suffixes such as "-tion"
+ * or "-ness" cost a single chain. It is built incrementally from sorted
+ * input with Daciuk's algorithm: only the path of the previous word is
+ * open, and states that leave it are either matched against the register
+ * of finished states or added to it. Each finished state's edges are laid
+ * out contiguously, sorted by label. Words carry no weights, because a
+ * shared state cannot tell which word it is finishing.
+ * Space: 4 bytes per state + 5 bytes per edge, after minimization
+ */
+class Dawg {
+private:
+  static constexpr uint32_t NO_STATE = numeric_limits<uint32_t>::max();
+  static constexpr size_t NO_LIMIT = numeric_limits<size_t>::max();
+
+  struct OpenState {
+    bool isFinal = false;
+    vector<pair<unsigned char, uint32_t>> edges;
+  };
+
+  // Finished states: state s owns edges [stateEdges[s], stateEdges[s + 1])
+  vector<uint32_t> stateEdges{0};
+  vector<bool> finalStates;
+  vector<unsigned char> edgeLabels;
+  vector<uint32_t> edgeTargets;
+  uint32_t root = NO_STATE;
+
+  // Build state, released by finish()
+  vector<OpenState> path{OpenState{}};
+  unordered_map<string, uint32_t> registry;
+  string previous;
+  string scratchKey;
+
+  KeyNormalizer normalizer;
+  int wordCount = 0;
+
+  /**
+   * Return the finished state equivalent to state, creating it if the
+   * register has none. Children are already finished, so equivalence is
+   * a plain comparison of the flag and (label, target) pairs.
+   * Time: O(fan-out) expected
+   */
+  uint32_t registerState(const OpenState &state) {
+    string signature(1, state.isFinal ? '\1' : '\0');
+    for (const auto &edge : state.edges) {
+      signature.push_back(static_cast<char>(edge.first));
+      signature.append(reinterpret_cast<const char *>(&edge.second),
+                       sizeof(edge.second));
+    }
+    auto found = registry.find(signature);
+    if (found != registry.end())
+      return found->second;
+    uint32_t id = static_cast<uint32_t>(finalStates.size());
+    for (const auto &edge : state.edges) {
+      edgeLabels.push_back(edge.first);
+      edgeTargets.push_back(edge.second);
+    }
+    stateEdges.push_back(static_cast<uint32_t>(edgeLabels.size()));
+    finalStates.push_back(state.isFinal);
+    registry.emplace(move(signature), id);
+    return id;
+  }
+
+  /** Minimize open states deeper than depth into the register */
+  void closePath(size_t depth) {
+    while (path.size() > depth + 1) {
+      uint32_t id = registerState(path.back());
+      path.pop_back();
+      path.back().edges.back().second = id;
+    }
+  }
+
+  uint32_t findChild(uint32_t state, unsigned char ch) const {
+    uint32_t first = stateEdges[state];
+    size_t count = stateEdges[state + 1] - first;
+    size_t pos = findLabel(edgeLabels.data() + first, count, ch);
+    return pos == count ? NO_STATE : edgeTargets[first + pos];
+  }
+
+  uint32_t locate(string_view raw) const {
+    if (root == NO_STATE)
+      return NO_STATE;
+    uint32_t current = root;
+    for (char byte : normalizer.trimmed(raw)) {
+      unsigned char ch = normalizer.map(byte);
+      if (ch == 0)
+        continue;
+      current = findChild(current, ch);
+      if (current == NO_STATE)
+        return NO_STATE;
+    }
+    return current;
+  }
+
+public:
+  explicit Dawg(const KeyNormalizer &keys = KeyNormalizer::letters())
+      : normalizer(keys) {}
+
+  /**
+   * Minimize an existing trie. Its words are streamed in sorted order
+   * straight into the incremental builder.
+   * Time: O(N) where N = trie nodes
+   */
+  explicit Dawg(const Trie &source) : normalizer(source.getNormalizer()) {
+    source.forEachSuggestion("", [&](const string &word) {
+      add(word);
+      return true;
+    });
+    finish();
+  }
+
+  /**
+   * Append word, which must normalize to a key strictly greater than the
+   * previous one. Out-of-order, duplicate or empty keys, and anything
+   * after finish(), are rejected and the method returns false.
+   * Time: O(L) amortized
+   */
+  bool add(string_view word) {
+    normalizer.normalize(word, scratchKey);
+    if (path.empty() || scratchKey.empty() ||
+        (wordCount > 0 && scratchKey <= previous))
+      return false;
+    size_t common = 0;
+    while (common < previous.size() && scratchKey[common] == previous[common])
+      common++;
+    closePath(common);
+    for (size_t i = common; i < scratchKey.size(); i++) {
+      path.back().edges.push_back(
+          {static_cast<unsigned char>(scratchKey[i]), NO_STATE});
+      path.emplace_back();
+    }
+    path.back().isFinal = true;
+    previous.swap(scratchKey);
+    wordCount++;
+    return true;
+  }
+
+  /**
+   * Minimize the last open path and drop the build-only register. Queries
+   * only see words once finish() has run; later add() calls fail.
+   * Time: O(L) for the final path
+   */
+  void finish() {
+    if (path.empty())
+      return;
+    closePath(0);
+    root = registerState(path.back());
+    path.clear();
+    path.shrink_to_fit();
+    unordered_map<string, uint32_t>().swap(registry);
+    string().swap(previous);
+    stateEdges.shrink_to_fit();
+    edgeLabels.shrink_to_fit();
+    edgeTargets.shrink_to_fit();
+  }
+
+  bool contains(string_view word) const {
+    uint32_t state = locate(word);
+    return state != NO_STATE && finalStates[state];
+  }
+
+  /**
+   * Stream words under prefix in sorted order, same contract as
+   * Trie::forEachSuggestion. Shared states are simply walked once per
+   * path that reaches them.
+   * Time: O(L + V) where V = edges followed to fill the page
+   */
+  template <typename Visitor>
+  void forEachSuggestion(string_view prefix, Visitor &&visit,
+                         size_t limit = NO_LIMIT, size_t offset = 0) const {
+    uint32_t start = locate(prefix);
+    if (start == NO_STATE || limit == 0)
+      return;
+    string buffer = normalizer.normalize(prefix);
+
+    auto emit = [&](uint32_t state) {
+      if (!finalStates[state])
+        return true;
+      if (offset > 0) {
+        offset--;
+        return true;
+      }
+      return visit(static_cast<const string &>(buffer)) && --limit != 0;
+    };
+    if (!emit(start))
+      return;
+    // Each frame is the next edge to follow and one past the state's last
+    vector<pair<uint32_t, uint32_t>> stack{
+        {stateEdges[start], stateEdges[start + 1]}};
+    while (!stack.empty()) {
+      auto &top = stack.back();
+      if (top.first == top.second) {
+        stack.pop_back();
+        if (!stack.empty())
+          buffer.pop_back();
+        continue;
+      }
+      uint32_t edge = top.first++;
+      uint32_t child = edgeTargets[edge];
+      buffer.push_back(static_cast<char>(edgeLabels[edge]));
+      stack.push_back({stateEdges[child], stateEdges[child + 1]});
+      if (!emit(child))
+        return;
+    }
+  }
+
+  vector<string> getSuggestions(string_view prefix, size_t limit = NO_LIMIT,
+                                size_t offset = 0) const {
+    vector<string> results;
+    forEachSuggestion(
+        prefix,
+        [&](const string &word) {
+          results.push_back(word);
+          return true;
+        },
+        limit, offset);
+    return results;
+  }
+
+  int getWordCount() const { return wordCount; }
+  uint32_t getStateCount() const {
+    return static_cast<uint32_t>(finalStates.size());
+  }
+  size_t getEdgeCount() const { return edgeLabels.size(); }
+  size_t getMemoryUsage() const {
+    return stateEdges.capacity() * sizeof(uint32_t) +
+           finalStates.capacity() / 8 + edgeLabels.capacity() +
+           edgeTargets.capacity() * sizeof(uint32_t);
+  }
+};
+
+// ==================== FIXED ALPHABET TRIE ====================
+/**
+ * Alphabets for FixedAlphabetTrie. Each one gives its symbol count, the
+ * symbol index of an input byte (-1 if the byte is not in the alphabet)
+ * and the byte for each index. The trie bakes these into constexpr tables,
+ * so they cost nothing at run time.
+ */
+struct LowercaseAlphabet {
+  static constexpr size_t SIZE = 26;
+  static constexpr int indexOf(unsigned char ch) {
+    if (ch >= 'a' && ch <= 'z')
+      return ch - 'a';
+    return ch >= 'A' && ch <= 'Z' ? ch - 'A' : -1;
+  }
+  static constexpr char symbol(size_t index) {
+    return static_cast<char>('a' + index);
+  }
+};
+
+struct DigitAlphabet {
+  static constexpr size_t SIZE = 10;
+  static constexpr int indexOf(unsigned char ch) {
+    return ch >= '0' && ch <= '9' ? ch - '0' : -1;
+  }
+  static constexpr char symbol(size_t index) {
+    return static_cast<char>('0' + index);
+  }
+};
+
+/** Nucleotides A, C, G, T in either case; N and other IUPAC codes drop */
+struct DnaAlphabet {
+  static constexpr size_t SIZE = 4;
+  static constexpr int indexOf(unsigned char ch) {
+    switch (ch | 0x20) {
+    case 'a':
+      return 0;
+    case 'c':
+      return 1;
+    case 'g':
+      return 2;
+    case 't':
+      return 3;
+    default:
+      return -1;
+    }
+  }
+  static constexpr char symbol(size_t index) { return "ACGT"[index]; }
+};
+
+/** Every byte is significant and kept as-is, with no case folding */
+struct ByteAlphabet {
+  static constexpr size_t SIZE = 256;
+  static constexpr int indexOf(unsigned char ch) { return ch; }
+  static constexpr char symbol(size_t index) {
+    return static_cast<char>(static_cast<unsigned char>(index));
+  }
+};
+
+/**
+ * FixedAlphabetTrie is a trie over a small alphabet fixed at compile time.
+ * Every node holds a dense child slot for each symbol, so one step is a
+ * table lookup plus an array index: no label search, no hashing and no
+ * branch on a missing child. Node 0 is an empty sentinel whose slots all
+ * point back at itself, so a failed lookup just stays at 0.
+ * Input bytes outside the alphabet are dropped, as in KeyNormalizer.
+ * Results come out in symbol order, with the same contracts as Trie.
+ * Space: O(nodes * SIZE * 4 bytes). That suits phone numbers (10 slots)
+ * and k-mers (4 slots); ByteAlphabet takes about 1 KiB per node.
+ */
+template <typename Alphabet> class FixedAlphabetTrie {
+public:
+  static constexpr size_t SIZE = Alphabet::SIZE;
+  static constexpr size_t NO_LIMIT = numeric_limits<size_t>::max();
+  static_assert(SIZE >= 1 && SIZE <= 256, "alphabet must fit in one byte");
+
+private:
+  using Index = conditional_t<(SIZE < 255), uint8_t, uint16_t>;
+  static constexpr Index NONE = numeric_limits<Index>::max();
+  static constexpr uint32_t EMPTY = 0;
+  static constexpr uint32_t ROOT = 1;
+
+  static constexpr array<Index, 256> buildIndex() {
+    array<Index, 256> table{};
+    for (size_t ch = 0; ch < 256; ch++) {
+      int index = Alphabet::indexOf(static_cast<unsigned char>(ch));
+      table[ch] = index < 0 ? NONE : static_cast<Index>(index);
+    }
+    return table;
+  }
+
+  static constexpr array<char, SIZE> buildSymbols() {
+    array<char, SIZE> table{};
+    for (size_t index = 0; index < SIZE; index++)
+      table[index] = Alphabet::symbol(index);
+    return table;
+  }
+
+  static constexpr array<Index, 256> INDEX = buildIndex();
+  static constexpr array<char, SIZE> SYMBOLS = buildSymbols();
+
+  static constexpr bool roundTrips() {
+    for (size_t index = 0; index < SIZE; index++)
+      if (INDEX[static_cast<unsigned char>(SYMBOLS[index])] != index)
+        return false;
+    return true;
+  }
+  static_assert(roundTrips(), "alphabet symbols must map back to themselves");
+
+  /** True when no byte is dropped, so the per-byte skip check compiles out */
+  static constexpr bool coversAllBytes() {
+    for (Index index : INDEX)
+      if (index == NONE)
+        return false;
+    return true;
+  }
+  static constexpr bool TOTAL = coversAllBytes();
+
+  struct Node {
+    array<uint32_t, SIZE> child;
+    uint32_t weight;
+    uint32_t maxWeight;
+    uint16_t childCount;
+    bool isEndOfWord;
+  };
+
+  vector<Node> nodes;
+  vector<uint32_t> freeNodes;
+  vector<uint32_t> scratchPath;
+  vector<Index> scratchKey;
+  int wordCount;
+
+  /** Symbol indexes of raw's alphabet bytes, in order */
+  void encode(string_view raw, vector<Index> &out) const {
+    out.clear();
+    for (char byte : raw) {
+      Index index = INDEX[static_cast<unsigned char>(byte)];
+      if (TOTAL || index != NONE)
+        out.push_back(index);
+    }
+  }
+
+  uint32_t locate(string_view raw) const {
+    uint32_t current = ROOT;
+    for (char byte : raw) {
+      Index index = INDEX[static_cast<unsigned char>(byte)];
+      if (TOTAL || index != NONE)
+        current = nodes[current].child[index];
+    }
+    return current;
+  }
+
+  uint32_t allocate() {
+    if (freeNodes.empty()) {
+      nodes.push_back(Node{});
+      return static_cast<uint32_t>(nodes.size() - 1);
+    }
+    uint32_t node = freeNodes.back();
+    freeNodes.pop_back();
+    nodes[node] = Node{};
+    return node;
+  }
+
+  /** Own weight and child bounds; EMPTY slots read the sentinel's 0 */
+  uint32_t subtreeMaxWeight(const Node &node) const {
+    uint32_t bound = node.isEndOfWord ? node.weight : 0;
+    for (uint32_t child : node.child)
+      bound = max(bound, nodes[child].maxWeight);
+    return bound;
+  }
+
+public:
+  FixedAlphabetTrie() : nodes(2, Node{}), wordCount(0) {}
+
+  /**
+   * Canonical form of raw: alphabet bytes only, case-folded to the
+   * alphabet's symbols
+   */
+  static string normalize(string_view raw) {
+    string key;
+    for (char byte : raw) {
+      Index index = INDEX[static_cast<unsigned char>(byte)];
+      if (TOTAL || index != NONE)
+        key.push_back(SYMBOLS[index]);
+    }
+    return key;
+  }
+
+  /**
+   * Insert word with a ranking weight; re-inserting keeps the higher
+   * weight. Keys with no alphabet bytes are ignored.
+   * Time: O(L)
+   */
+  void insert(string_view word, uint32_t weight = 1) {
+    encode(word, scratchKey);
+    if (scratchKey.empty())
+      return;
+    uint32_t current = ROOT;
+    nodes[current].maxWeight = max(nodes[current].maxWeight, weight);
+    for (Index index : scratchKey) {
+      uint32_t next = nodes[current].child[index];
+      if (next == EMPTY) {
+        next = allocate();
+        nodes[current].child[index] = next;
+        nodes[current].childCount++;
+      }
+      current = next;
+      nodes[current].maxWeight = max(nodes[current].maxWeight, weight);
+    }
+    Node &last = nodes[current];
+    if (!last.isEndOfWord) {
+      last.isEndOfWord = true;
+      wordCount++;
+    }
+    last.weight = max(last.weight, weight);
+  }
+
+  /**
+   * Check whether word is stored - Time: O(L), one load per byte
+   */
+  bool contains(string_view word) const {
+    return nodes[locate(word)].isEndOfWord;
+  }
+
+  /**
+   * Remove word. Childless, wordless nodes are pruned bottom-up onto a
+   * free list, and subtree bounds are recomputed along the surviving path.
+   * Returns false if word was not present.
+   * Time: O(L * SIZE) worst case
+   */
+  bool remove(string_view word) {
+    encode(word, scratchKey);
+    vector<uint32_t> &path = scratchPath;
+    path.assign(1, ROOT);
+    for (Index index : scratchKey)
+      path.push_back(nodes[path.back()].child[index]);
+    uint32_t target = path.back();
+    if (scratchKey.empty() || !nodes[target].isEndOfWord)
+      return false;
+    nodes[target].isEndOfWord = false;
+    nodes[target].weight = 0;
+    wordCount--;
+
+    size_t depth = scratchKey.size();
+    while (depth > 0 && nodes[path[depth]].childCount == 0 &&
+           !nodes[path[depth]].isEndOfWord) {
+      Node &parent = nodes[path[depth - 1]];
+      parent.child[scratchKey[depth - 1]] = EMPTY;
+      parent.childCount--;
+      freeNodes.push_back(path[depth]);
+      depth--;
+    }
+    for (size_t i = depth + 1; i-- > 0;) {
+      Node &current = nodes[path[i]];
+      uint32_t bound = subtreeMaxWeight(current);
+      if (bound == current.maxWeight)
+        break;
+      current.maxWeight = bound;
+    }
+    return true;
+  }
+
+  /**
+   * Stream suggestions in symbol order, same contract as
+   * Trie::forEachSuggestion
+   * Time: O(L + V * SIZE) where V = nodes visited to fill the page
+   */
+  template <typename Visitor>
+  void forEachSuggestion(string_view prefix, Visitor &&visit,
+                         size_t limit = NO_LIMIT,
+                         size_t offset = 0) const {
+    uint32_t start = locate(prefix);
+    if (start == EMPTY || limit == 0)
+      return;
+    string buffer = normalize(prefix);
+
+    struct Frame {
+      uint32_t node;
+      size_t next;
+    };
+    auto emit = [&](uint32_t node) {
+      if (!nodes[node].isEndOfWord)
+        return true;
+      if (offset > 0) {
+        offset--;
+        return true;
+      }
+      return visit(static_cast<const string &>(buffer)) && --limit != 0;
+    };
+    if (!emit(start))
+      return;
+    vector<Frame> stack{{start, 0}};
+    while (!stack.empty()) {
+      Frame &top = stack.back();
+      const Node &node = nodes[top.node];
+      while (top.next < SIZE && node.child[top.next] == EMPTY)
+        top.next++;
+      if (top.next == SIZE) {
+        stack.pop_back();
+        if (!stack.empty())
+          buffer.pop_back();
+        continue;
+      }
+      size_t index = top.next++;
+      uint32_t child = node.child[index];
+      buffer.push_back(SYMBOLS[index]);
+      stack.push_back({child, 0});
+      if (!emit(child))
+        return;
+    }
+  }
+
+  vector<string> getSuggestions(string_view prefix,
+                                size_t limit = NO_LIMIT,
+                                size_t offset = 0) const {
+    vector<string> results;
+    forEachSuggestion(
+        prefix,
+        [&](const string &word) {
+          results.push_back(word);
+          return true;
+        },
+        limit, offset);
+    return results;
+  }
+
+  /**
+   * Top k words under prefix by weight, same ranking as Trie::getTopK
+   * Time: O(k * SIZE * log(k * SIZE))
+   */
+  vector<Suggestion> getTopK(string_view prefix, size_t k) const {
+    uint32_t start = locate(prefix);
+    if (start == EMPTY)
+      return {};
+    return bestFirstTopK(
+        start, nodes[start].maxWeight, normalize(prefix), k,
+        [&](uint32_t id, auto &&pushWord, auto &&pushChild) {
+          const Node &node = nodes[id];
+          if (node.isEndOfWord)
+            pushWord(node.weight);
+          for (size_t index = 0; index < SIZE; index++)
+            if (node.child[index] != EMPTY)
+              pushChild(node.child[index], SYMBOLS[index],
+                        nodes[node.child[index]].maxWeight);
+        });
+  }
+
+  int getWordCount() const { return wordCount; }
+  uint32_t getNodeCount() const {
+    return static_cast<uint32_t>(nodes.size() - 1 - freeNodes.size());
+  }
+  size_t getMemoryUsage() const {
+    return nodes.capacity() * sizeof(Node) +
+           freeNodes.capacity() * sizeof(uint32_t);
+  }
+};
+
+// ==================== SHARDED TRIE ====================
+/**
+ * ShardBackend is one partition of a ShardedTrie: an in-process Trie
+ * (LocalShard) or a trie server reached over the line protocol. Calls may
+ * block on I/O, so none of them are const. Keys arrive already normalized.
+ */
+class ShardBackend {
+public:
+  virtual ~ShardBackend() = default;
+
+  /** Returns true if word was not present before */
+  virtual bool insert(string_view word, uint32_t weight) = 0;
+  virtual bool remove(string_view word) = 0;
+  virtual vector<string> getSuggestions(string_view prefix, size_t limit) = 0;
+  virtual vector<Suggestion> getTopK(string_view prefix, size_t k) = 0;
+  virtual int getWordCount() = 0;
+};
+
+class LocalShard : public ShardBackend {
+private:
+  Trie trie;
+
+public:
+  explicit LocalShard(const KeyNormalizer &keys = KeyNormalizer::letters())
+      : trie(keys) {}
+
+  bool insert(string_view word, uint32_t weight) override {
+    int before = trie.getWordCount();
+    trie.insert(word, weight);
+    return trie.getWordCount() > before;
+  }
+  bool remove(string_view word) override { return trie.remove(word); }
+  vector<string> getSuggestions(string_view prefix, size_t limit) override {
+    return trie.getSuggestions(prefix, limit);
+  }
+  vector<Suggestion> getTopK(string_view prefix, size_t k) override {
+    return trie.getTopK(prefix, k);
+  }
+  int getWordCount() override { return trie.getWordCount(); }
+
+  Trie &getTrie() { return trie; }
+};
+
+/**
+ * ShardedTrie partitions the key space into contiguous ranges, each held by
+ * one ShardBackend. Shard i owns normalized keys from its lower bound up to
+ * the next shard's, and the lowest shard also takes anything below its own
+ * bound. A query prefix only reaches the shards whose range can hold a
+ * key starting with it: the shard the prefix itself routes to, plus any
+ * later shards whose bound starts with the prefix.
+ *
+ * Because ranges are ordered and disjoint, merging the sorted lists is a
+ * concatenation in shard order, pulled lazily: later shards are asked
+ * only for whatever the page still needs. Top-K asks every overlapping
+ * shard for k, in parallel on the optional pool, and k-way merges the
+ * lists. Not thread-safe; callers serialize access, as with Trie.
+ */
+class ShardedTrie {
+public:
+  static constexpr size_t NO_LIMIT = numeric_limits<size_t>::max();
+
+private:
+  struct Shard {
+    string lowerBound;
+    unique_ptr<ShardBackend> backend;
+  };
+
+  vector<Shard> shards;
+  KeyNormalizer normalizer;
+  ThreadPool *pool;
+  string scratchKey;
+
+  /**
+   * Index of the shard owning key
+   * Time: O(log S) where S = shard count
+   */
+  size_t route(const string &key) const {
+    auto it = upper_bound(
+        shards.begin(), shards.end(), key,
+        [](const string &value, const Shard &shard) {
+          return value < shard.lowerBound;
+        });
+    return it == shards.begin() ? 0
+                                : static_cast<size_t>(it - shards.begin()) - 1;
+  }
+
+  /** Shards [first, last) whose range can hold a key starting with prefix */
+  pair<size_t, size_t> overlapping(const string &prefix) const {
+    size_t first = route(prefix), last = first + 1;
+    while (last < shards.size() &&
+           shards[last].lowerBound.compare(0, prefix.size(), prefix) == 0)
+      last++;
+    return {first, last};
+  }
+
+public:
+  explicit ShardedTrie(const KeyNormalizer &keys = KeyNormalizer::letters(),
+                       ThreadPool *workers = nullptr)
+      : normalizer(keys), pool(workers) {}
+
+  /**
+   * Add a shard owning keys from lowerBound (normalized here) up to the
+   * next shard's bound. Returns false if a shard already starts there.
+   */
+  bool addShard(string_view lowerBound, unique_ptr<ShardBackend> backend) {
+    Shard shard{normalizer.normalize(lowerBound), move(backend)};
+    auto it = lower_bound(shards.begin(), shards.end(), shard.lowerBound,
+                          [](const Shard &existing, const string &value) {
+                            return existing.lowerBound < value;
+                          });
+    if (it != shards.end() && it->lowerBound == shard.lowerBound)
+      return false;
+    shards.insert(it, move(shard));
+    return true;
+  }
+
+  size_t getShardCount() const { return shards.size(); }
+
+  bool insert(string_view word, uint32_t weight = 1) {
+    normalizer.normalize(word, scratchKey);
+    if (scratchKey.empty() || shards.empty())
+      return false;
+    return shards[route(scratchKey)].backend->insert(scratchKey, weight);
+  }
+
+  bool remove(string_view word) {
+    normalizer.normalize(word, scratchKey);
+    if (scratchKey.empty() || shards.empty())
+      return false;
+    return shards[route(scratchKey)].backend->remove(scratchKey);
+  }
+
+  /**
+   * One sorted page of words under prefix, same contract as
+   * Trie::getSuggestions
+   * Time: one backend call per overlapping shard until the page is full
+   */
+  vector<string> getSuggestions(string_view prefix, size_t limit = NO_LIMIT,
+                                size_t offset = 0) {
+    vector<string> results;
+    if (shards.empty() || limit == 0)
+      return results;
+    string key = normalizer.normalize(prefix);
+    auto [first, last] = overlapping(key);
+    for (size_t i = first; i < last; i++) {
+      size_t want = limit == NO_LIMIT || offset > NO_LIMIT - limit
+                        ? NO_LIMIT
+                        : offset + limit;
+      vector<string> page = shards[i].backend->getSuggestions(key, want);
+      if (page.size() <= offset) {
+        offset -= page.size();
+        continue;
+      }
+      size_t take = min(page.size() - offset, limit);
+      move(page.begin() + offset, page.begin() + offset + take,
+           back_inserter(results));
+      offset = 0;
+      if (limit != NO_LIMIT && (limit -= take) == 0)
+        break;
+    }
+    return results;
+  }
+
+  /**
+   * The k highest-weighted words under prefix across all shards, ordered
+   * like Trie::getTopK (equal weights alphabetically)
+   * Time: fan-out of S' shards, then O(k log S') to merge
+   */
+  vector<Suggestion> getTopK(string_view prefix, size_t k) {
+    if (shards.empty() || k == 0)
+      return {};
+    string key = normalizer.normalize(prefix);
+    auto [first, last] = overlapping(key);
+    vector<vector<Suggestion>> partial(last - first);
+    auto ask = [&](size_t i) {
+      partial[i] = shards[first + i].backend->getTopK(key, k);
+    };
+    if (pool && partial.size() > 1)
+      pool->parallelFor(partial.size(), ask);
+    else
+      for (size_t i = 0; i < partial.size(); i++)
+        ask(i);
+
+    // Heap of list heads; (list, position) pairs ordered best-first
+    auto worse = [&](const pair<size_t, size_t> &a,
+                     const pair<size_t, size_t> &b) {
+      const Suggestion &x = partial[a.first][a.second];
+      const Suggestion &y = partial[b.first][b.second];
+      if (x.weight != y.weight)
+        return x.weight < y.weight;
+      return x.word > y.word;
+    };
+    priority_queue<pair<size_t, size_t>, vector<pair<size_t, size_t>>,
+                   decltype(worse)>
+        heads(worse);
+    for (size_t i = 0; i < partial.size(); i++) {
+      if (!partial[i].empty())
+        heads.push({i, 0});
+    }
+    vector<Suggestion> results;
+    while (!heads.empty() && results.size() < k) {
+      auto [list, position] = heads.top();
+      heads.pop();
+      results.push_back(move(partial[list][position]));
+      if (position + 1 < partial[list].size())
+        heads.push({list, position + 1});
+    }
+    return results;
+  }
+
+  int getWordCount() {
+    int total = 0;
+    for (Shard &shard : shards)
+      total += shard.backend->getWordCount();
+    return total;
+  }
+};
+
+#ifndef _WIN32
+// ==================== WRITE-AHEAD LOG ====================
+/**
+ * WriteAheadLog is an append-only file of insert/remove records. Each
+ * record is [length][crc32][op][weight][word bytes]. append() only
+ * buffers; commit() makes everything appended so far durable. It is a
+ * group commit: one thread writes the whole buffer and syncs once, and
+ * threads that commit meanwhile just wait for that sync. A single-threaded
+ * server gets the same effect by committing once per batch of pipelined
+ * requests instead of once per write.
+ */
+class WriteAheadLog {
+public:
+  enum Op : uint8_t { INSERT = 1, REMOVE = 2 };
+
+private:
+  static constexpr size_t RECORD_HEADER = 2 * sizeof(uint32_t);
+  static constexpr size_t MAX_RECORD = 1 << 20;
+
+public:
+  /** Longest word one record can carry (the payload also holds op, weight) */
+  static constexpr size_t MAX_WORD = MAX_RECORD - 1 - sizeof(uint32_t);
+
+private:
+
+  int fd = -1;
+  mutex lock;
+  condition_variable synced;
+  string pending;
+  uint64_t appended = 0;
+  uint64_t durable = 0;
+  uint64_t fileBytes = 0;
+  bool syncing = false;
+  bool failed = false;
+
+  static uint32_t crc32(const char *data, size_t size) {
+    static const array<uint32_t, 256> table = [] {
+      array<uint32_t, 256> entries{};
+      for (uint32_t i = 0; i < 256; i++) {
+        uint32_t value = i;
+        for (int bit = 0; bit < 8; bit++)
+          value = (value >> 1) ^ (value & 1 ? 0xEDB88320u : 0);
+        entries[i] = value;
+      }
+      return entries;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; i++)
+      crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^
+            (crc >> 8);
+    return ~crc;
+  }
+
+  static bool writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+      ssize_t wrote = ::write(fd, data, size);
+      if (wrote < 0 && errno == EINTR)
+        continue;
+      if (wrote <= 0)
+        return false;
+      data += wrote;
+      size -= static_cast<size_t>(wrote);
+    }
+    return true;
+  }
+
+public:
+  WriteAheadLog() = default;
+  ~WriteAheadLog() { close(); }
+  WriteAheadLog(const WriteAheadLog &) = delete;
+  WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+  /** Flush a file's data (not necessarily its metadata) to stable storage */
+  static bool syncFile(int fd) {
+#ifdef __linux__
+    return fdatasync(fd) == 0;
+#else
+    return fsync(fd) == 0;
+#endif
+  }
+
+  /**
+   * Feed every intact record of the log at path to visit(op, word,
+   * weight), in order. A torn or corrupt tail, e.g. from a crash during
+   * a write, is cut off so appends resume after the last good record.
+   * Returns the number of records replayed, or -1 if path is unreadable.
+   * Time: O(file size)
+   */
+  template <typename Visitor>
+  static long replay(const string &path, Visitor &&visit) {
+    ifstream in(path, ios::binary);
+    if (!in)
+      return -1;
+    string data((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    size_t offset = 0;
+    long records = 0;
+    while (data.size() - offset >= RECORD_HEADER) {
+      uint32_t length, crc;
+      memcpy(&length, data.data() + offset, sizeof(length));
+      memcpy(&crc, data.data() + offset + sizeof(length), sizeof(crc));
+      const char *payload = data.data() + offset + RECORD_HEADER;
+      if (length < 1 + sizeof(uint32_t) || length > MAX_RECORD ||
+          length > data.size() - offset - RECORD_HEADER ||
+          crc32(payload, length) != crc)
+        break;
+      uint32_t weight;
+      memcpy(&weight, payload + 1, sizeof(weight));
+      visit(static_cast<Op>(payload[0]),
+            string_view(payload + 1 + sizeof(weight),
+                        length - 1 - sizeof(weight)),
+            weight);
+      offset += RECORD_HEADER + length;
+      records++;
+    }
+    if (offset < data.size() && ::truncate(path.c_str(), offset) != 0)
+      return -1;
+    return records;
+  }
+
+  /** Open (creating if needed) the log at path for appending */
+  bool open(const string &path, string &error) {
+    close();
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+      error = "cannot open " + path + ": " + strerror(errno);
+      close();
+      return false;
+    }
+    fileBytes = static_cast<uint64_t>(info.st_size);
+    failed = false;
+    return true;
+  }
+
+  /**
+   * Buffer one record; it is durable once a later commit() returns.
+   * A word longer than MAX_WORD is rejected, never cut down, so replay
+   * can only ever restore the exact key that was applied.
+   */
+  bool append(Op op, string_view word, uint32_t weight) {
+    if (word.size() > MAX_WORD)
+      return false;
+    size_t length = 1 + sizeof(weight) + word.size();
+    string payload;
+    payload.reserve(length);
+    payload.push_back(static_cast<char>(op));
+    payload.append(reinterpret_cast<const char *>(&weight), sizeof(weight));
+    payload.append(word.data(), word.size());
+    uint32_t header[2] = {static_cast<uint32_t>(length),
+                          crc32(payload.data(), payload.size())};
+    lock_guard<mutex> guard(lock);
+    pending.append(reinterpret_cast<const char *>(header), sizeof(header));
+    pending += payload;
+    appended++;
+    return true;
+  }
+
+  /**
+   * Make every record appended so far durable; false if a write or sync
+   * failed, after which the log stays failed until reopened
+   */
+  bool commit() {
+    unique_lock<mutex> guard(lock);
+    uint64_t target = appended;
+    while (durable < target && !failed) {
+      if (syncing) {
+        synced.wait(guard);
+        continue;
+      }
+      syncing = true;
+      string batch;
+      batch.swap(pending);
+      uint64_t upTo = appended;
+      guard.unlock();
+      bool ok = writeAll(fd, batch.data(), batch.size()) && syncFile(fd);
+      guard.lock();
+      syncing = false;
+      if (ok) {
+        durable = upTo;
+        fileBytes += batch.size();
+      } else {
+        failed = true;
+      }
+      synced.notify_all();
+    }
+    return !failed;
+  }
+
+  /** Whether a commit has failed since the log was opened */
+  bool hasFailed() {
+    lock_guard<mutex> guard(lock);
+    return failed;
+  }
+
+  /** Bytes in the file plus bytes still buffered */
+  uint64_t size() {
+    lock_guard<mutex> guard(lock);
+    return fileBytes + pending.size();
+  }
+
+  void close() {
+    if (fd < 0)
+      return;
+    commit();
+    ::close(fd);
+    fd = -1;
+  }
+};
+
+// ==================== TRIE STORE ====================
+/**
+ * TrieStore keeps a Trie durable in a data directory holding
+ * snapshot-<N>.bin files (Trie::serializeSnapshot images) and wal-<M>.log
+ * segments. Snapshot N contains every change logged in segments below N.
+ * Opening the store thaws the newest readable snapshot into the trie with
+ * one sorted bulk load, then replays segments N and up and keeps
+ * appending to the newest one. Writes go to the
+ * trie and the current segment. Once that segment passes compactBytes,
+ * compaction starts a new segment, and a background thread rebuilds the
+ * contents from the last snapshot and the segments now closed, then
+ * writes, syncs and renames the new snapshot. The caller only pays for
+ * closing the segment; the rebuild holds a second copy of the words.
+ * Superseded snapshots and segments are deleted only after the rename.
+ */
+class TrieStore {
+private:
+  Trie &trie;
+  string directory;
+  WriteAheadLog log;
+  uint64_t segment = 0;
+  // Newest snapshot loaded or written, if hasBase; after open() only the
+  // compaction thread touches these
+  uint64_t base = 0;
+  bool hasBase = false;
+  size_t compactBytes;
+  long replayed = 0;
+  // Set by open() when segments exist but no snapshot lies under them, so
+  // the seed they were logged over is missing; checkpoint() replays them
+  bool unseeded = false;
+  // Writes applied since the last successful commit, oldest first, with
+  // what each word held before so a failed commit can undo them
+  struct Undo {
+    string word;
+    bool existed;
+    uint32_t weight;
+  };
+  vector<Undo> uncommitted;
+  thread compactor;
+  atomic<bool> compacting{false};
+
+  string pathFor(const char *kind, uint64_t number, const char *suffix) const {
+    return directory + "/" + kind + "-" + to_string(number) + suffix;
+  }
+
+  /** Numbers N of directory entries named <kind>-N<suffix> */
+  static vector<uint64_t> listNumbered(const string &dir, const string &kind,
+                                       const string &suffix) {
+    vector<uint64_t> numbers;
+    DIR *handle = opendir(dir.c_str());
+    if (!handle)
+      return numbers;
+    string head = kind + "-";
+    while (dirent *entry = readdir(handle)) {
+      string name = entry->d_name;
+      if (name.size() <= head.size() + suffix.size() ||
+          name.compare(0, head.size(), head) != 0 ||
+          name.compare(name.size() - suffix.size(), suffix.size(), suffix) != 0)
+        continue;
+      string digits = name.substr(head.size(),
+                                  name.size() - head.size() - suffix.size());
+      if (digits.find_first_not_of("0123456789") == string::npos)
+        numbers.push_back(strtoull(digits.c_str(), nullptr, 10));
+    }
+    closedir(handle);
+    sort(numbers.begin(), numbers.end());
+    return numbers;
+  }
+
+  void syncDirectory() const {
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      fsync(fd);
+      ::close(fd);
+    }
+  }
+
+  /** Remove snapshots and segments older than snapshot number keep */
+  void removeBefore(uint64_t keep) const {
+    for (uint64_t number : listNumbered(directory, "snapshot", ".bin"))
+      if (number < keep)
+        ::unlink(pathFor("snapshot", number, ".bin").c_str());
+    for (uint64_t number : listNumbered(directory, "wal", ".log"))
+      if (number < keep)
+        ::unlink(pathFor("wal", number, ".log").c_str());
+  }
+
+  bool writeSnapshot(uint64_t number, const string &image) const {
+    string temporary = pathFor("snapshot", number, ".tmp");
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      return false;
+    bool ok = true;
+    for (size_t done = 0; ok && done < image.size();) {
+      ssize_t wrote = ::write(fd, image.data() + done, image.size() - done);
+      if (wrote < 0 && errno == EINTR)
+        continue;
+      ok = wrote > 0;
+      done += ok ? static_cast<size_t>(wrote) : 0;
+    }
+    ok = ok && fsync(fd) == 0;
+    ::close(fd);
+    if (!ok || ::rename(temporary.c_str(),
+                        pathFor("snapshot", number, ".bin").c_str()) != 0) {
+      ::unlink(temporary.c_str());
+      return false;
+    }
+    syncDirectory();
+    return true;
+  }
+
+  /** Bulk-load snapshot number into target; false if it will not map */
+  bool thaw(Trie &target, uint64_t number) const {
+    MappedTrie image;
+    if (!image.open(pathFor("snapshot", number, ".bin")))
+      return false;
+    target.loadWords([&](auto &&emit) { image.forEachWord(emit); });
+    return true;
+  }
+
+  /** Replay one segment into target; records replayed, or -1 */
+  long replaySegment(Trie &target, uint64_t number) const {
+    return WriteAheadLog::replay(
+        pathFor("wal", number, ".log"),
+        [&](WriteAheadLog::Op op, string_view word, uint32_t weight) {
+          if (op == WriteAheadLog::INSERT)
+            target.insert(word, weight);
+          else if (op == WriteAheadLog::REMOVE)
+            target.remove(word);
+        });
+  }
+
+  /** Commit the log; if that fails, undo every write it held */
+  bool commitLog() {
+    bool ok = log.commit();
+    if (!ok) {
+      for (auto it = uncommitted.rbegin(); it != uncommitted.rend(); ++it) {
+        trie.remove(it->word);
+        if (it->existed)
+          trie.insert(it->word, it->weight);
+      }
+    }
+    uncommitted.clear();
+    return ok;
+  }
+
+  /**
+   * Start a new segment and run build(number) on the background thread,
+   * where number names both the new segment and the snapshot build
+   * writes. Returns false if a compaction is still running.
+   */
+  template <typename Build> bool rotate(Build &&build) {
+    if (compacting.load())
+      return false;
+    if (compactor.joinable())
+      compactor.join();
+    string error;
+    if (!commitLog() || !log.open(pathFor("wal", segment + 1, ".log"), error))
+      return false;
+    segment++;
+    compacting = true;
+    compactor = thread([this, number = segment, build = move(build)]() {
+      if (build(number)) {
+        removeBefore(number);
+        base = number;
+        hasBase = true;
+      }
+      compacting = false;
+    });
+    return true;
+  }
+
+public:
+  static constexpr size_t DEFAULT_COMPACT_BYTES = 4 << 20;
+
+  explicit TrieStore(Trie &target, size_t compactAfter = DEFAULT_COMPACT_BYTES)
+      : trie(target), compactBytes(compactAfter) {}
+  ~TrieStore() {
+    log.close();
+    if (compactor.joinable())
+      compactor.join();
+  }
+  TrieStore(const TrieStore &) = delete;
+  TrieStore &operator=(const TrieStore &) = delete;
+
+  /**
+   * Recover the trie (which must be empty) from dir, creating dir if it
+   * does not exist. fresh is set when dir holds no readable snapshot: the
+   * caller should then seed the trie and checkpoint(). Segments without a
+   * snapshot under them were logged over a seed that never became
+   * durable, so they are left for checkpoint() to replay over the new
+   * seed and writes go to a segment after them.
+   * Time: O(N + W) where W = logged records since the last snapshot
+   */
+  bool open(const string &dir, bool &fresh, string &error) {
+    directory = dir;
+    if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+      error = "cannot create " + dir + ": " + strerror(errno);
+      return false;
+    }
+    vector<uint64_t> snapshots = listNumbered(dir, "snapshot", ".bin");
+    base = 0;
+    hasBase = false;
+    for (auto it = snapshots.rbegin(); it != snapshots.rend() && !hasBase;
+         ++it) {
+      if (thaw(trie, *it)) {
+        base = *it;
+        hasBase = true;
+      }
+    }
+
+    replayed = 0;
+    vector<uint64_t> segments = listNumbered(dir, "wal", ".log");
+    fresh = !hasBase;
+    unseeded = fresh && !segments.empty();
+    if (unseeded) {
+      segment = segments.back() + 1;
+      return log.open(pathFor("wal", segment, ".log"), error);
+    }
+    uint64_t newest = base;
+    for (uint64_t number : segments) {
+      if (number < base)
+        continue;
+      long records = replaySegment(trie, number);
+      if (records < 0) {
+        error = "cannot read " + pathFor("wal", number, ".log");
+        return false;
+      }
+      replayed += records;
+      newest = number;
+    }
+    removeBefore(base);
+    // Keep appending to the newest segment; replay cut off any torn tail
+    segment = newest;
+    return log.open(pathFor("wal", segment, ".log"), error);
+  }
+
+  /** Whether word fits in one log record; longer words cannot be stored */
+  static bool loggable(string_view word) {
+    return word.size() <= WriteAheadLog::MAX_WORD;
+  }
+
+  /**
+   * Whether writes are still accepted. After a failed commit the log is
+   * left failed, so every later write is refused rather than applied in
+   * memory and lost on restart.
+   */
+  bool writable() { return !log.hasFailed(); }
+
+  /**
+   * Log and apply an insert. One that would change nothing succeeds
+   * without a record. Returns false, touching neither the log nor the
+   * trie, if the word is not loggable or the store is not writable.
+   * The insert is undone if the next commit fails.
+   */
+  bool insert(string_view word, uint32_t weight) {
+    if (!writable() || !loggable(word))
+      return false;
+    if (!trie.insertWouldChange(word, weight))
+      return true;
+    Undo undo{string(word), false, 0};
+    undo.existed = trie.findWeight(word, undo.weight);
+    if (!log.append(WriteAheadLog::INSERT, word, weight))
+      return false;
+    trie.insert(word, weight);
+    uncommitted.push_back(move(undo));
+    return true;
+  }
+
+  /**
+   * Log and apply a remove; false if absent, not loggable or not
+   * writable (nothing changes). The remove is undone if the next commit
+   * fails.
+   */
+  bool remove(string_view word) {
+    uint32_t weight = 0;
+    if (!writable() || !trie.findWeight(word, weight) ||
+        !log.append(WriteAheadLog::REMOVE, word, 0))
+      return false;
+    uncommitted.push_back({string(word), true, weight});
+    return trie.remove(word);
+  }
+
+  /**
+   * Make all logged writes durable, then start a compaction if the
+   * current segment has outgrown compactBytes. If the commit fails, the
+   * writes since the last commit are undone in the trie, so it never
+   * holds a change that a restart would lose.
+   */
+  bool commit() {
+    if (!commitLog())
+      return false;
+    if (log.size() >= compactBytes)
+      compact();
+    return true;
+  }
+
+  /**
+   * Start a background compaction. Returns false if one is still
+   * running. The thread never reads the live trie: it replays the closed
+   * segments over the last snapshot into a private Trie, so writers keep
+   * going while it runs. Time on the caller: one log commit and open.
+   */
+  bool compact() {
+    return rotate([this, keys = trie.getNormalizer()](uint64_t number) {
+      Trie rebuilt(keys);
+      if (hasBase && !thaw(rebuilt, base))
+        return false;
+      for (uint64_t closed : listNumbered(directory, "wal", ".log"))
+        if (closed >= base && closed < number &&
+            replaySegment(rebuilt, closed) < 0)
+          return false;
+      return writeSnapshot(number, rebuilt.serializeSnapshot());
+    });
+  }
+
+  /**
+   * Snapshot the trie's current contents, e.g. a seed dictionary that was
+   * never logged, after replaying any segments open() left unseeded over
+   * it. Everything runs on the caller's thread and the log moves to a new
+   * segment only once the snapshot is durable, so on failure the
+   * directory still has no base and the next start seeds it again.
+   * O(N) (about 0.4 s for a million words), so this suits startup rather
+   * than a serving loop.
+   */
+  bool checkpoint(string &error) {
+    if (compactor.joinable())
+      compactor.join();
+    if (!commitLog()) {
+      error = "cannot commit " + pathFor("wal", segment, ".log");
+      return false;
+    }
+    if (unseeded) {
+      for (uint64_t number : listNumbered(directory, "wal", ".log")) {
+        long records = number < segment ? replaySegment(trie, number) : 0;
+        if (records < 0) {
+          error = "cannot read " + pathFor("wal", number, ".log");
+          return false;
+        }
+        replayed += records;
+      }
+    }
+    uint64_t number = segment + 1;
+    if (!writeSnapshot(number, trie.serializeSnapshot())) {
+      error = "cannot write " + pathFor("snapshot", number, ".bin");
+      return false;
+    }
+    if (!log.open(pathFor("wal", number, ".log"), error))
+      return false;
+    segment = number;
+    base = number;
+    hasBase = true;
+    unseeded = false;
+    removeBefore(number);
+    return true;
+  }
+
+  long getReplayedRecords() const { return replayed; }
+  uint64_t getSegment() const { return segment; }
+};
+#endif
+
+} // namespace autosuggest
+
+#endif // TRIE_HPP
@@ -1,152 +1,905 @@
-#include <algorithm>
-#include <cctype>
+#include "trie.hpp"
+
+#include <cerrno>
+#include <charconv>
 #include <chrono>
+#include <csignal>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#endif
+
 using namespace std;
 using namespace chrono;
+using namespace autosuggest;
 
 // ==================== ANSI COLOR CODES ====================
 namespace Color {
-const string RESET = "\033[0m";
-const string BOLD = "\033[1m";
-const string DIM = "\033[2m";
-const string CYAN = "\033[36m";
-const string GREEN = "\033[32m";
-const string YELLOW = "\033[33m";
-const string BLUE = "\033[34m";
-const string MAGENTA = "\033[35m";
-const string RED = "\033[31m";
-} // namespace Color
+string RESET = "\033[0m";
+string BOLD = "\033[1m";
+string DIM = "\033[2m";
+string CYAN = "\033[36m";
+string GREEN = "\033[32m";
+string YELLOW = "\033[33m";
+string BLUE = "\033[34m";
+string MAGENTA = "\033[35m";
+string RED = "\033[31m";
 
-// ==================== TRIE NODE STRUCTURE ====================
 /**
- * TrieNode represents a single node in the Trie data structure.
- * Space Complexity: O(ALPHABET_SIZE) per node in worst case
+ * Blank every code, for --no-color and the NO_COLOR convention
  */
-struct TrieNode {
-  unordered_map<char, TrieNode *> children;
-  bool isEndOfWord;
-  TrieNode() : isEndOfWord(false) {}
-};
+void disable() {
+  for (string *code : {&RESET, &BOLD, &DIM, &CYAN, &GREEN, &YELLOW, &BLUE,
+                       &MAGENTA, &RED})
+    code->clear();
+}
+} // namespace Color
 
-// ==================== TRIE CLASS ====================
+// ==================== LINE PROTOCOL ====================
 /**
- * Trie implements a prefix tree for efficient word storage and retrieval.
+ * CommandHandler runs the headless line protocol against a Trie, or a
+ * read-only MappedTrie. Each request is one line; list replies are
+ * "OK <n>" followed by n lines, scalar replies are a single "OK <value>",
+ * failures are "ERR <reason>". Numeric arguments come first so the key is
+ * always the rest of the line and may be empty or contain spaces:
+ *
+ *   GET <prefix>                      all matches, sorted
+ *   PAGE <limit> <offset> <prefix>    one page of sorted matches
+ *   TOPK <k> <prefix>                 "word<TAB>weight", best first
+ *   FUZZY <edits> <limit> <prefix>    matches within edits of prefix;
+ *                                     edits is capped at |prefix| - 1
+ *   ADD <word>[<TAB>weight]           OK 1 if new, OK 0 if present
+ *   DEL <word>                        OK 1 if removed, OK 0 if absent
+ *   COUNT                             number of stored words
+ *   METRICS                           Prometheus text exposition lines
+ *   QUIT                              close the session
+ *
+ * Blank lines are ignored so they never produce an unmatched reply.
  */
-class Trie {
+class CommandHandler {
 private:
-  TrieNode *root;
-  int wordCount;
+  Trie *trie;
+  const MappedTrie *snapshot;
+  ShardedTrie *router;
+#ifndef _WIN32
+  TrieStore *store = nullptr;
+  // Replies to logged writes since the last sync(): where each sits in
+  // its output buffer, so a failed commit can take the OK back
+  struct Pending {
+    string *out;
+    size_t offset;
+    size_t length;
+  };
+  vector<Pending> unsynced;
+#endif
+  string body;
 
   /**
-   * Recursively destroy all Trie nodes
-   * Time Complexity: O(N) where N = total nodes
+   * Parse one unsigned decimal argument and the single space after it
    */
-  void destroyTrie(TrieNode *node) {
-    if (!node)
-      return;
-    for (auto &pair : node->children) {
-      destroyTrie(pair.second);
+  static bool takeNumber(string_view &rest, size_t &value) {
+    const char *first = rest.data();
+    const char *last = first + rest.size();
+    auto [end, error] = from_chars(first, last, value);
+    if (error != errc() || (end != last && *end != ' '))
+      return false;
+    rest.remove_prefix(end - first + (end != last ? 1 : 0));
+    return true;
+  }
+
+  /**
+   * Move the lines accumulated in body into out behind an "OK <n>" header
+   */
+  void flushList(size_t count, string &out) {
+    out += "OK ";
+    out += to_string(count);
+    out += '\n';
+    out += body;
+    body.clear();
+  }
+
+  template <typename Source>
+  void list(const Source &source, string_view prefix, size_t limit,
+            size_t offset, string &out) {
+    size_t count = 0;
+    source.forEachSuggestion(
+        prefix,
+        [&](const string &word) {
+          body += word;
+          body += '\n';
+          count++;
+          return true;
+        },
+        limit, offset);
+    flushList(count, out);
+  }
+
+  void listWords(const vector<string> &words, string &out) {
+    for (const string &word : words) {
+      body += word;
+      body += '\n';
     }
-    delete node;
+    flushList(words.size(), out);
+  }
+
+  void scalar(const string &name, const string &type, double value) {
+    ostringstream number;
+    number << value;
+    body += "# TYPE " + name + " " + type + "\n" + name + " " + number.str() +
+            "\n";
   }
 
   /**
-   * Recursively collect all words from a given node
-   * Time Complexity: O(K * M) where K = words, M = avg length
+   * Render gauges, counters and histograms in Prometheus text format into
+   * body; returns the number of lines written
    */
-  void collectSuggestions(TrieNode *node, string currentPrefix,
-                          vector<string> &results) const {
-    if (node->isEndOfWord) {
-      results.push_back(currentPrefix);
+  size_t renderMetrics() {
+    if (router) {
+      scalar("trie_words", "gauge", router->getWordCount());
+      scalar("trie_shards", "gauge",
+             static_cast<double>(router->getShardCount()));
+    } else if (!trie) {
+      scalar("trie_words", "gauge", snapshot->getWordCount());
+      scalar("trie_nodes", "gauge", snapshot->getNodeCount());
+      scalar("trie_memory_bytes", "gauge",
+            static_cast<double>(snapshot->getMemoryUsage()));
+    } else {
+      ShapeStats shape = trie->getShapeStats();
+      scalar("trie_words", "gauge", trie->getWordCount());
+      scalar("trie_nodes", "gauge", shape.nodes);
+      scalar("trie_memory_bytes", "gauge", static_cast<double>(shape.bytes));
+      scalar("trie_max_depth", "gauge", static_cast<double>(shape.maxDepth));
+      scalar("trie_average_fanout", "gauge", shape.averageFanout);
+      if (trie->hasCache()) {
+        CacheStats cacheStats = trie->getCacheStats();
+        scalar("trie_cache_hits_total", "counter",
+              static_cast<double>(cacheStats.hits));
+        scalar("trie_cache_misses_total", "counter",
+              static_cast<double>(cacheStats.misses));
+        scalar("trie_cache_entries", "gauge",
+              static_cast<double>(cacheStats.entries));
+      }
+      if (const TrieMetrics *metrics = trie->getMetrics()) {
+        scalar("trie_bulk_loaded_words_total", "counter",
+              static_cast<double>(metrics->bulkLoaded.load()));
+        body += "# TYPE trie_operation_duration_nanoseconds histogram\n";
+        for (size_t op = 0; op < TrieMetrics::OPERATIONS; op++)
+          metrics->latency[op].writePrometheus(
+              body, "trie_operation_duration_nanoseconds",
+              string("op=\"") + TrieMetrics::OPERATION_NAMES[op] + "\",");
+        body += "# TYPE trie_suggest_nodes_visited histogram\n";
+        metrics->nodesVisited.writePrometheus(body,
+                                              "trie_suggest_nodes_visited", "");
+        body += "# TYPE trie_suggest_results histogram\n";
+        metrics->resultSize.writePrometheus(body, "trie_suggest_results", "");
+      }
     }
-    for (const auto &[key, child] : node->children) {
-      collectSuggestions(child, currentPrefix + key, results);
+    return static_cast<size_t>(count(body.begin(), body.end(), '\n'));
+  }
+
+  void listTopK(const vector<Suggestion> &top, string &out) {
+    for (const Suggestion &entry : top) {
+      body += entry.word;
+      body += '\t';
+      body += to_string(entry.weight);
+      body += '\n';
     }
+    flushList(top.size(), out);
   }
 
+public:
+  explicit CommandHandler(Trie &source)
+      : trie(&source), snapshot(nullptr), router(nullptr) {}
+  explicit CommandHandler(const MappedTrie &source)
+      : trie(nullptr), snapshot(&source), router(nullptr) {}
+  explicit CommandHandler(ShardedTrie &source)
+      : trie(nullptr), snapshot(nullptr), router(&source) {}
+
+#ifndef _WIN32
+  /** Log ADD and DEL through store, which must wrap this handler's trie */
+  void setStore(TrieStore *durable) { store = durable; }
+#endif
+
   /**
-   * Find TrieNode for a given prefix
-   * Time Complexity: O(L) where L = prefix length
+   * Make the writes executed so far durable; call before sending their
+   * replies, and before the output buffers they went to are changed.
+   * Returns false if the log could not be committed, after rewriting
+   * each of those replies to an ERR line.
    */
-  TrieNode *searchPrefix(const string &prefix) const {
-    TrieNode *current = root;
-    for (char ch : prefix) {
-      if (current->children.find(ch) == current->children.end()) {
-        return nullptr;
+  bool sync() {
+#ifndef _WIN32
+    if (store) {
+      bool committed = store->commit();
+      if (!committed)
+        for (auto it = unsynced.rbegin(); it != unsynced.rend(); ++it)
+          it->out->replace(it->offset, it->length,
+                           "ERR write-ahead log commit failed\n");
+      unsynced.clear();
+      return committed;
+    }
+#endif
+    return true;
+  }
+
+  /**
+   * Execute one request line and append its reply to out
+   * Returns false once the client has asked to QUIT
+   */
+  bool execute(string_view line, string &out) {
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    if (line.find_first_not_of(" \t") == string_view::npos)
+      return true;
+    size_t space = line.find(' ');
+    string_view verb = line.substr(0, space);
+    string_view rest =
+        space == string_view::npos ? string_view() : line.substr(space + 1);
+    size_t first = 0, second = 0;
+
+    if (verb == "GET") {
+      if (trie)
+        list(*trie, rest, Trie::NO_LIMIT, 0, out);
+      else if (router)
+        listWords(router->getSuggestions(rest), out);
+      else
+        list(*snapshot, rest, Trie::NO_LIMIT, 0, out);
+    } else if (verb == "PAGE") {
+      if (!takeNumber(rest, first) || !takeNumber(rest, second)) {
+        out += "ERR usage: PAGE <limit> <offset> <prefix>\n";
+      } else if (trie) {
+        list(*trie, rest, first, second, out);
+      } else if (router) {
+        listWords(router->getSuggestions(rest, first, second), out);
+      } else {
+        list(*snapshot, rest, first, second, out);
+      }
+    } else if (verb == "TOPK") {
+      if (!takeNumber(rest, first))
+        out += "ERR usage: TOPK <k> <prefix>\n";
+      else
+        listTopK(trie     ? trie->getTopK(rest, first)
+                 : router ? router->getTopK(rest, first)
+                          : snapshot->getTopK(rest, first),
+                 out);
+    } else if (verb == "FUZZY") {
+      if (!takeNumber(rest, first) || !takeNumber(rest, second)) {
+        out += "ERR usage: FUZZY <edits> <limit> <prefix>\n";
+      } else if (!trie) {
+        out += router ? "ERR fuzzy search is not available on a shard router\n"
+                      : "ERR fuzzy search is not available on a snapshot\n";
+      } else {
+        listWords(trie->getFuzzySuggestions(rest, first, second), out);
+      }
+    } else if (verb == "ADD" || verb == "DEL") {
+      if (!trie && !router) {
+        out += "ERR read-only snapshot\n";
+        return true;
+      }
+#ifndef _WIN32
+      if (store && !store->writable()) {
+        out += "ERR write-ahead log failed; writes are disabled\n";
+        return true;
+      }
+#endif
+      bool changed = false, rejected = false;
+      if (verb == "ADD") {
+        string word(rest);
+        uint32_t weight = splitWeight(word);
+        if (router) {
+          changed = router->insert(word, weight);
+#ifndef _WIN32
+        } else if (store) {
+          int before = trie->getWordCount();
+          rejected = !store->insert(word, weight);
+          changed = trie->getWordCount() > before;
+#endif
+        } else {
+          int before = trie->getWordCount();
+          trie->insert(word, weight);
+          changed = trie->getWordCount() > before;
+        }
+      } else {
+        if (router)
+          changed = router->remove(rest);
+#ifndef _WIN32
+        else if (store && !TrieStore::loggable(rest))
+          rejected = true;
+        else if (store)
+          changed = store->remove(rest);
+#endif
+        else
+          changed = trie->remove(rest);
       }
-      current = current->children[ch];
+      if (rejected) {
+        out += "ERR word too long for the write-ahead log\n";
+        return true;
+      }
+      string_view reply = changed ? "OK 1\n" : "OK 0\n";
+#ifndef _WIN32
+      if (store)
+        unsynced.push_back({&out, out.size(), reply.size()});
+#endif
+      out += reply;
+    } else if (verb == "COUNT") {
+      out += "OK ";
+      out += to_string(trie     ? trie->getWordCount()
+                       : router ? router->getWordCount()
+                                : snapshot->getWordCount());
+      out += '\n';
+    } else if (verb == "METRICS") {
+      flushList(renderMetrics(), out);
+    } else if (verb == "QUIT") {
+      out += "OK bye\n";
+      return false;
+    } else {
+      out += "ERR unknown command\n";
     }
-    return current;
+    return true;
   }
+};
 
-  string toLower(const string &str) const {
-    string result = str;
-    transform(result.begin(), result.end(), result.begin(), ::tolower);
-    return result;
+/**
+ * Serve the line protocol over a stream pair (stdin/stdout). Replies are
+ * buffered and written only when no further pipelined input is already
+ * buffered, or when the buffer grows large, so batched requests cost one
+ * write instead of one per line.
+ */
+void serveStream(istream &in, ostream &out, CommandHandler &handler) {
+  static constexpr size_t FLUSH_BYTES = 1 << 16;
+  string line, reply;
+  bool more = true;
+  while (more && getline(in, line)) {
+    more = handler.execute(line, reply);
+    if (!more || reply.size() >= FLUSH_BYTES || in.rdbuf()->in_avail() <= 0) {
+      if (!handler.sync())
+        cerr << "write-ahead log commit failed\n";
+      out.write(reply.data(), static_cast<streamsize>(reply.size()));
+      out.flush();
+      reply.clear();
+    }
   }
+  handler.sync();
+  out.write(reply.data(), static_cast<streamsize>(reply.size()));
+  out.flush();
+}
+
+#ifndef _WIN32
+// ==================== SOCKET SERVER ====================
+/**
+ * EventLoop is a minimal readiness poller: epoll on Linux, poll(2) on
+ * other POSIX systems. A new fd is watched for input; watch() switches
+ * input and output interest as a connection's buffers fill and drain.
+ * Hang-ups and errors are reported as both readable and writable, so the
+ * next read or write sees them even when only one side is watched.
+ */
+class EventLoop {
+public:
+  struct Event {
+    int fd;
+    bool readable;
+    bool writable;
+  };
+
+private:
+#ifdef __linux__
+  int epollFd;
 
-  string trim(const string &str) const {
-    size_t first = str.find_first_not_of(" \t\n\r");
-    if (first == string::npos)
-      return "";
-    size_t last = str.find_last_not_of(" \t\n\r");
-    return str.substr(first, last - first + 1);
+  void control(int op, int fd, bool wantRead, bool wantWrite) {
+    epoll_event event{};
+    event.events = (wantRead ? uint32_t(EPOLLIN) : 0u) |
+                   (wantWrite ? uint32_t(EPOLLOUT) : 0u);
+    event.data.fd = fd;
+    epoll_ctl(epollFd, op, fd, &event);
   }
+#else
+  vector<pollfd> watched;
+#endif
 
 public:
-  Trie() : wordCount(0) { root = new TrieNode(); }
-  ~Trie() { destroyTrie(root); }
+#ifdef __linux__
+  EventLoop() : epollFd(epoll_create1(0)) {}
+  ~EventLoop() { ::close(epollFd); }
 
-  /**
-   * Insert word into Trie - Time: O(L), Space: O(L) worst case
-   */
-  void insert(const string &word) {
-    string cleanWord = toLower(trim(word));
-    if (cleanWord.empty())
+  bool valid() const { return epollFd >= 0; }
+  void add(int fd) { control(EPOLL_CTL_ADD, fd, true, false); }
+  void watch(int fd, bool wantRead, bool wantWrite) {
+    control(EPOLL_CTL_MOD, fd, wantRead, wantWrite);
+  }
+  void remove(int fd) { epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr); }
+
+  void wait(vector<Event> &ready) {
+    epoll_event events[64];
+    ready.clear();
+    int count = epoll_wait(epollFd, events, 64, -1);
+    for (int i = 0; i < count; i++) {
+      uint32_t flags = events[i].events;
+      ready.push_back({events[i].data.fd,
+                       (flags & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0,
+                       (flags & (EPOLLOUT | EPOLLHUP | EPOLLERR)) != 0});
+    }
+  }
+#else
+  EventLoop() {}
+
+  bool valid() const { return true; }
+  void add(int fd) { watched.push_back({fd, POLLIN, 0}); }
+  void watch(int fd, bool wantRead, bool wantWrite) {
+    for (pollfd &entry : watched) {
+      if (entry.fd == fd)
+        entry.events = static_cast<short>((wantRead ? POLLIN : 0) |
+                                          (wantWrite ? POLLOUT : 0));
+    }
+  }
+  void remove(int fd) {
+    watched.erase(remove_if(watched.begin(), watched.end(),
+                            [&](const pollfd &entry) { return entry.fd == fd; }),
+                  watched.end());
+  }
+
+  void wait(vector<Event> &ready) {
+    ready.clear();
+    if (poll(watched.data(), watched.size(), -1) <= 0)
       return;
+    for (const pollfd &entry : watched) {
+      if (entry.revents)
+        ready.push_back({entry.fd,
+                         (entry.revents & (POLLIN | POLLHUP | POLLERR)) != 0,
+                         (entry.revents & (POLLOUT | POLLHUP | POLLERR)) !=
+                             0});
+    }
+  }
+#endif
+};
 
-    TrieNode *current = root;
-    for (char ch : cleanWord) {
-      if (!isalpha(ch))
+/**
+ * Parse "unix:PATH" or "[HOST:]PORT" (HOST defaults to 127.0.0.1) into a
+ * socket address. Returns false and sets error if it is malformed.
+ */
+bool parseAddress(const string &address, sockaddr_storage &storage,
+                  socklen_t &length, string &error) {
+  storage = sockaddr_storage{};
+  if (address.compare(0, 5, "unix:") == 0) {
+    sockaddr_un &local = reinterpret_cast<sockaddr_un &>(storage);
+    string path = address.substr(5);
+    if (path.empty() || path.size() >= sizeof(local.sun_path)) {
+      error = "invalid unix socket path";
+      return false;
+    }
+    local.sun_family = AF_UNIX;
+    memcpy(local.sun_path, path.c_str(), path.size() + 1);
+    length = sizeof(sockaddr_un);
+    return true;
+  }
+  size_t colon = address.rfind(':');
+  string host = colon == string::npos ? "127.0.0.1" : address.substr(0, colon);
+  string port = colon == string::npos ? address : address.substr(colon + 1);
+  sockaddr_in &inet = reinterpret_cast<sockaddr_in &>(storage);
+  inet.sin_family = AF_INET;
+  char *end = nullptr;
+  unsigned long number = strtoul(port.c_str(), &end, 10);
+  if (port.empty() || *end != '\0' || number > 65535 ||
+      inet_pton(AF_INET, host.c_str(), &inet.sin_addr) != 1) {
+    error = "invalid address " + address;
+    return false;
+  }
+  inet.sin_port = htons(static_cast<uint16_t>(number));
+  length = sizeof(sockaddr_in);
+  return true;
+}
+
+/**
+ * Open a non-blocking listening socket for a parseAddress address.
+ * Returns -1 and sets error on failure.
+ */
+int openListener(const string &address, string &error) {
+  sockaddr_storage storage;
+  socklen_t length;
+  if (!parseAddress(address, storage, length, error))
+    return -1;
+  int fd = socket(storage.ss_family, SOCK_STREAM, 0);
+  if (storage.ss_family == AF_UNIX) {
+    ::unlink(reinterpret_cast<sockaddr_un &>(storage).sun_path);
+  } else if (fd >= 0) {
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  }
+  if (fd < 0 ||
+      ::bind(fd, reinterpret_cast<sockaddr *>(&storage), length) != 0) {
+    error = "cannot bind " + address + ": " + strerror(errno);
+    if (fd >= 0)
+      ::close(fd);
+    return -1;
+  }
+  if (::listen(fd, SOMAXCONN) != 0 ||
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+    error = string("cannot listen: ") + strerror(errno);
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Serve the line protocol to any number of clients from one thread.
+ * Requests are pipelined: every complete line already received is
+ * executed and its reply appended to the connection's output buffer,
+ * which is written as far as the socket allows and finished when the
+ * socket becomes writable again. Queries never block on a slow client.
+ * A client that sends faster than it reads is paused: once its unsent
+ * output passes OUTPUT_LIMIT, no further lines run and its input is not
+ * watched until the socket has taken that output.
+ * Replies are sent only after one handler.sync() per wakeup, so every
+ * write from every ready connection shares a single log commit.
+ * Returns only if the listener cannot be set up.
+ */
+int serveSocket(const string &address, CommandHandler &handler) {
+  static constexpr size_t MAX_LINE = 1 << 16;
+  static constexpr size_t OUTPUT_LIMIT = 1 << 20;
+  struct Connection {
+    string input;
+    string output;
+    bool ended = false;   // Peer sent EOF; buffered lines still run
+    bool closing = false; // Run nothing more; close once output is sent
+  };
+
+  string error;
+  int listener = openListener(address, error);
+  EventLoop loop;
+  if (listener < 0 || !loop.valid()) {
+    cerr << (listener < 0 ? error : "cannot create event loop") << "\n";
+    if (listener >= 0)
+      ::close(listener);
+    return 1;
+  }
+  signal(SIGPIPE, SIG_IGN);
+  loop.add(listener);
+  cerr << "Listening on " << address << "\n";
+
+  unordered_map<int, Connection> connections;
+  auto drop = [&](int fd) {
+    loop.remove(fd);
+    ::close(fd);
+    connections.erase(fd);
+  };
+  // Write what the socket takes now; returns false if the peer is gone
+  auto flush = [&](int fd, Connection &conn) {
+    while (!conn.output.empty()) {
+      ssize_t sent = ::write(fd, conn.output.data(), conn.output.size());
+      if (sent < 0)
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+      conn.output.erase(0, static_cast<size_t>(sent));
+    }
+    return true;
+  };
+  auto reading = [&](const Connection &conn) {
+    return !conn.ended && !conn.closing && conn.output.size() < OUTPUT_LIMIT;
+  };
+
+  vector<EventLoop::Event> ready;
+  vector<int> touched;
+  char chunk[1 << 14];
+  while (true) {
+    loop.wait(ready);
+    touched.clear();
+    for (const EventLoop::Event &event : ready) {
+      if (event.fd == listener) {
+        int client;
+        while ((client = ::accept(listener, nullptr, nullptr)) >= 0) {
+          fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+          connections[client];
+          loop.add(client);
+        }
+        continue;
+      }
+      auto found = connections.find(event.fd);
+      if (found == connections.end())
+        continue;
+      Connection &conn = found->second;
+      // Output left from earlier wakeups was committed before it was
+      // queued, so it can go out now and make room for paused lines
+      if (event.writable && !flush(event.fd, conn)) {
+        drop(event.fd);
         continue;
-      if (current->children.find(ch) == current->children.end()) {
-        current->children[ch] = new TrieNode();
       }
-      current = current->children[ch];
+      touched.push_back(event.fd);
+
+      if (event.readable && reading(conn)) {
+        ssize_t received;
+        while ((received = ::read(event.fd, chunk, sizeof(chunk))) > 0)
+          conn.input.append(chunk, static_cast<size_t>(received));
+        // A peer that half-closes after pipelining still gets answers:
+        // complete lines are executed first, then the connection closes
+        // once its output has been flushed
+        conn.ended = received == 0 ||
+                     (received < 0 && errno != EAGAIN &&
+                      errno != EWOULDBLOCK && errno != EINTR);
+      }
+
+      size_t start = 0, end;
+      while (!conn.closing && conn.output.size() < OUTPUT_LIMIT &&
+             (end = conn.input.find('\n', start)) != string::npos) {
+        string_view line(conn.input.data() + start, end - start);
+        if (!handler.execute(line, conn.output))
+          conn.closing = true;
+        start = end + 1;
+      }
+      conn.input.erase(0, start);
+      bool complete = conn.input.find('\n') != string::npos;
+      if (!complete && conn.input.size() > MAX_LINE) {
+        conn.output += "ERR line too long\n";
+        conn.closing = true;
+      }
+      if (conn.ended && !complete)
+        conn.closing = true;
     }
-    if (!current->isEndOfWord) {
-      current->isEndOfWord = true;
-      wordCount++;
+
+    if (!handler.sync())
+      cerr << "write-ahead log commit failed\n";
+    for (int fd : touched) {
+      auto found = connections.find(fd);
+      if (found == connections.end())
+        continue;
+      Connection &conn = found->second;
+      if (!flush(fd, conn) || (conn.closing && conn.output.empty())) {
+        drop(fd);
+        continue;
+      }
+      // Lines held back by OUTPUT_LIMIT resume on the next writable
+      // event, which comes at once if the socket took everything
+      bool held = !conn.closing && conn.input.find('\n') != string::npos;
+      loop.watch(fd, reading(conn), !conn.output.empty() || held);
     }
   }
+}
+
+// ==================== REMOTE SHARD ====================
+/**
+ * RemoteShard is a ShardBackend served by another --listen process. It
+ * keeps one non-blocking connection, opened on first use and reopened
+ * after any I/O error. Each call, connect included, must finish within
+ * the timeout; a shard that stalls is dropped like one that fails. A
+ * failed call reports the error on stderr and returns an empty result, so
+ * a router degrades to the shards still reachable.
+ */
+class RemoteShard : public ShardBackend {
+private:
+  string address;
+  milliseconds timeout;
+  int fd;
+  string input;
+  // End of the call in progress
+  steady_clock::time_point deadline;
+
+  /** Wait until fd is ready for events; false once the deadline passes */
+  bool await(short events) {
+    while (true) {
+      auto left = duration_cast<milliseconds>(deadline - steady_clock::now());
+      if (left.count() <= 0)
+        return false;
+      pollfd entry{fd, events, 0};
+      int ready = ::poll(&entry, 1, static_cast<int>(left.count()));
+      if (ready > 0)
+        return true;
+      if (ready < 0 && errno != EINTR)
+        return false;
+    }
+  }
+
+  void disconnect(const string &why) {
+    if (fd >= 0)
+      ::close(fd);
+    fd = -1;
+    input.clear();
+    cerr << "shard " << address << ": " << why << "\n";
+  }
+
+  bool connectIfNeeded() {
+    if (fd >= 0)
+      return true;
+    sockaddr_storage storage;
+    socklen_t length;
+    string error;
+    if (!parseAddress(address, storage, length, error)) {
+      disconnect(error);
+      return false;
+    }
+    fd = socket(storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0 || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+      disconnect(string("cannot connect: ") + strerror(errno));
+      return false;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&storage), length) != 0) {
+      if (errno != EINPROGRESS) {
+        disconnect(string("cannot connect: ") + strerror(errno));
+        return false;
+      }
+      if (!await(POLLOUT)) {
+        disconnect("connect timed out");
+        return false;
+      }
+      int error = 0;
+      socklen_t size = sizeof(error);
+      if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size) != 0 ||
+          error != 0) {
+        disconnect(string("cannot connect: ") + strerror(error));
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /** Read one reply line; false on close, error or timeout */
+  bool readLine(string &line) {
+    size_t newline;
+    while ((newline = input.find('\n')) == string::npos) {
+      char chunk[1 << 14];
+      ssize_t got = ::read(fd, chunk, sizeof(chunk));
+      if (got < 0 && errno == EINTR)
+        continue;
+      if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        if (!await(POLLIN))
+          return false;
+        continue;
+      }
+      if (got <= 0)
+        return false;
+      input.append(chunk, static_cast<size_t>(got));
+    }
+    line.assign(input, 0, newline);
+    input.erase(0, newline + 1);
+    return true;
+  }
 
   /**
-   * Get sorted suggestions for prefix
-   * Time: O(L + K*M + K*log(K)) where K = results, M = avg length
+   * Send one request line and read its "OK <n>" header; if lines is not
+   * null, the n lines that follow are appended to it. Returns false on any
+   * error reply or I/O failure.
    */
-  vector<string> getSuggestions(const string &prefix) const {
-    vector<string> results;
-    string cleanPrefix = toLower(trim(prefix));
-    TrieNode *prefixNode =
-        cleanPrefix.empty() ? root : searchPrefix(cleanPrefix);
+  bool call(const string &request, size_t &value, vector<string> *lines) {
+    deadline = steady_clock::now() + timeout;
+    if (!connectIfNeeded())
+      return false;
+    string wire = request + "\n";
+    for (size_t sent = 0; sent < wire.size();) {
+      ssize_t wrote = ::write(fd, wire.data() + sent, wire.size() - sent);
+      if (wrote < 0 && errno == EINTR)
+        continue;
+      if (wrote < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        if (!await(POLLOUT)) {
+          disconnect("write timed out");
+          return false;
+        }
+        continue;
+      }
+      if (wrote <= 0) {
+        disconnect(string("write failed: ") + strerror(errno));
+        return false;
+      }
+      sent += static_cast<size_t>(wrote);
+    }
+    string header;
+    if (!readLine(header)) {
+      disconnect("no reply");
+      return false;
+    }
+    if (header.compare(0, 3, "OK ") != 0) {
+      cerr << "shard " << address << ": " << header << "\n";
+      return false;
+    }
+    value = strtoull(header.c_str() + 3, nullptr, 10);
+    for (size_t i = 0; lines && i < value; i++) {
+      string line;
+      if (!readLine(line)) {
+        disconnect("truncated reply");
+        return false;
+      }
+      lines->push_back(move(line));
+    }
+    return true;
+  }
 
-    if (!prefixNode)
-      return results;
-    collectSuggestions(prefixNode, cleanPrefix, results);
-    sort(results.begin(), results.end());
-    return results;
+public:
+  static constexpr milliseconds DEFAULT_TIMEOUT{2000};
+
+  explicit RemoteShard(string target, milliseconds limit = DEFAULT_TIMEOUT)
+      : address(move(target)), timeout(limit), fd(-1) {}
+  ~RemoteShard() override {
+    if (fd >= 0)
+      ::close(fd);
   }
+  RemoteShard(const RemoteShard &) = delete;
+  RemoteShard &operator=(const RemoteShard &) = delete;
 
-  int getWordCount() const { return wordCount; }
+  bool insert(string_view word, uint32_t weight) override {
+    size_t added = 0;
+    return call("ADD " + string(word) + "\t" + to_string(weight), added,
+                nullptr) &&
+           added == 1;
+  }
+  bool remove(string_view word) override {
+    size_t removed = 0;
+    return call("DEL " + string(word), removed, nullptr) && removed == 1;
+  }
+  vector<string> getSuggestions(string_view prefix, size_t limit) override {
+    vector<string> words;
+    size_t count;
+    call(limit == ShardedTrie::NO_LIMIT
+             ? "GET " + string(prefix)
+             : "PAGE " + to_string(limit) + " 0 " + string(prefix),
+         count, &words);
+    return words;
+  }
+  vector<Suggestion> getTopK(string_view prefix, size_t k) override {
+    vector<string> lines;
+    vector<Suggestion> top;
+    size_t count;
+    if (!call("TOPK " + to_string(k) + " " + string(prefix), count, &lines))
+      return top;
+    for (string &line : lines) {
+      uint32_t weight = splitWeight(line);
+      top.push_back({move(line), weight});
+    }
+    return top;
+  }
+  int getWordCount() override {
+    size_t count = 0;
+    call("COUNT", count, nullptr);
+    return static_cast<int>(count);
+  }
 };
+#endif
 
 // ==================== UI HELPER FUNCTIONS ====================
+/**
+ * BufferedWriter gathers output in one string and passes it to the stream
+ * in 64 KiB chunks. A long listing then costs a few writes instead of one
+ * per line, which is what cout does on a terminal, where it is line
+ * buffered.
+ */
+class BufferedWriter {
+private:
+  static constexpr size_t FLUSH_BYTES = 1 << 16;
+  ostream &out;
+  string buffer;
+
+public:
+  explicit BufferedWriter(ostream &target) : out(target) {
+    buffer.reserve(FLUSH_BYTES);
+  }
+  ~BufferedWriter() { flush(); }
+
+  BufferedWriter &operator<<(string_view text) {
+    buffer.append(text.data(), text.size());
+    if (buffer.size() >= FLUSH_BYTES)
+      flush();
+    return *this;
+  }
+  BufferedWriter &operator<<(size_t number) {
+    return *this << to_string(number);
+  }
+
+  void flush() {
+    out.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+    out.flush();
+    buffer.clear();
+  }
+};
 
 void printBanner() {
   cout << "\n" << Color::BOLD << Color::CYAN;
@@ -182,6 +935,42 @@ void printInfo(const string &msg) {
   cout << "  " << Color::BLUE << "ℹ " << msg << Color::RESET << "\n";
 }
 
+string formatBytes(size_t bytes) {
+  ostringstream text;
+  text << fixed << setprecision(1);
+  if (bytes < 1024)
+    text << bytes << " B";
+  else if (bytes < 1024 * 1024)
+    text << bytes / 1024.0 << " KB";
+  else
+    text << bytes / (1024.0 * 1024.0) << " MB";
+  return text.str();
+}
+
+string formatNanos(uint64_t nanos) {
+  ostringstream text;
+  text << fixed << setprecision(1);
+  if (nanos < 1000)
+    text << nanos << "ns";
+  else if (nanos < 1000000)
+    text << nanos / 1000.0 << "μs";
+  else
+    text << nanos / 1000000.0 << "ms";
+  return text.str();
+}
+
+/**
+ * One statistics row for an operation: call count and latency quantiles
+ * (log2 buckets, so each figure is an upper bound within 2x)
+ */
+void printLatencyLine(const string &label, const Log2Histogram &latency) {
+  cout << "  " << Color::CYAN << label << Color::RESET << latency.count();
+  if (latency.count() > 0)
+    cout << " (p50 ≤ " << formatNanos(latency.quantile(0.5)) << ", p99 ≤ "
+         << formatNanos(latency.quantile(0.99)) << ")";
+  cout << "\n";
+}
+
 void printMenu() {
   cout << "\n";
   printThickLine();
@@ -236,9 +1025,141 @@ void printHelp() {
 }
 
 // ==================== MAIN FUNCTION ====================
-int main() {
-  Trie trie;
-  printBanner();
+int main(int argc, char *argv[]) {
+  string dictPath, snapshotPath, saveSnapshotPath, keyMode = "letters";
+  string profilePath;
+  string listenAddress, dataDir;
+  vector<pair<string, string>> shardSpecs;
+  size_t buildThreads = 1, cacheEntries = 0;
+#ifndef _WIN32
+  size_t compactBytes = TrieStore::DEFAULT_COMPACT_BYTES;
+  milliseconds shardTimeout = RemoteShard::DEFAULT_TIMEOUT;
+#endif
+  bool serve = false, noColor = false;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "--dict" && i + 1 < argc) {
+      dictPath = argv[++i];
+    } else if (arg == "--cache" && i + 1 < argc) {
+      cacheEntries = strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--threads" && i + 1 < argc) {
+      buildThreads = max<size_t>(1, strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--snapshot" && i + 1 < argc) {
+      snapshotPath = argv[++i];
+    } else if (arg == "--save-snapshot" && i + 1 < argc) {
+      saveSnapshotPath = argv[++i];
+    } else if (arg == "--snapshot-profile" && i + 1 < argc) {
+      profilePath = argv[++i];
+    } else if (arg == "--keys" && i + 1 < argc &&
+               (string(argv[i + 1]) == "letters" ||
+                string(argv[i + 1]) == "bytes")) {
+      keyMode = argv[++i];
+    } else if (arg == "--no-color") {
+      noColor = true;
+    } else if (arg == "--serve") {
+      serve = true;
+    } else if (arg == "--listen" && i + 1 < argc) {
+      listenAddress = argv[++i];
+    } else if (arg == "--data-dir" && i + 1 < argc) {
+      dataDir = argv[++i];
+#ifndef _WIN32
+    } else if (arg == "--compact-bytes" && i + 1 < argc) {
+      compactBytes = max<size_t>(1, strtoull(argv[++i], nullptr, 10));
+    } else if (arg == "--shard-timeout" && i + 1 < argc) {
+      shardTimeout = milliseconds(
+          max<unsigned long long>(1, strtoull(argv[++i], nullptr, 10)));
+#endif
+    } else if (arg == "--shard" && i + 1 < argc &&
+               strchr(argv[i + 1], '=') != nullptr) {
+      string spec = argv[++i];
+      size_t equals = spec.find('=');
+      shardSpecs.push_back({spec.substr(0, equals), spec.substr(equals + 1)});
+    } else {
+      cerr << "Usage: " << argv[0]
+           << " [--dict PATH] [--threads N] [--cache ENTRIES]"
+              " [--snapshot PATH] [--save-snapshot PATH [--snapshot-profile PATH]]"
+              " [--keys letters|bytes] [--serve | --listen ADDRESS]"
+              " [--shard LOWER=local|ADDRESS ... [--shard-timeout MS]]"
+              " [--data-dir DIR [--compact-bytes N]] [--no-color]\n";
+      return 1;
+    }
+  }
+
+  const char *noColorEnv = getenv("NO_COLOR");
+  if (noColor || (noColorEnv && *noColorEnv))
+    Color::disable();
+
+  // Headless modes keep stdout for protocol replies only
+  bool headless = serve || !listenAddress.empty();
+  auto fail = [&](const string &msg) {
+    if (headless)
+      cerr << msg << "\n";
+    else
+      printError(msg);
+    return 1;
+  };
+  auto info = [&](const string &msg) {
+    if (!headless)
+      printInfo(msg);
+  };
+
+  auto serveHeadless = [&](CommandHandler &handler) {
+    if (!listenAddress.empty()) {
+#ifdef _WIN32
+      return fail("--listen is not supported on this platform");
+#else
+      return serveSocket(listenAddress, handler);
+#endif
+    }
+    ios::sync_with_stdio(false);
+    serveStream(cin, cout, handler);
+    return 0;
+  };
+  const KeyNormalizer &keys = keyMode == "bytes" ? KeyNormalizer::bytes()
+                                                 : KeyNormalizer::letters();
+
+  // Router mode: no local dictionary; --dict is routed into the shards
+  if (!shardSpecs.empty()) {
+    if (!headless || !snapshotPath.empty() || !saveSnapshotPath.empty())
+      return fail("--shard needs --serve or --listen and no snapshot");
+    unique_ptr<ThreadPool> pool;
+    if (buildThreads > 1)
+      pool = make_unique<ThreadPool>(buildThreads);
+    ShardedTrie router(keys, pool.get());
+    for (const auto &[lower, address] : shardSpecs) {
+      unique_ptr<ShardBackend> backend;
+      if (address == "local") {
+        backend = make_unique<LocalShard>(keys);
+      } else {
+#ifdef _WIN32
+        return fail("remote shards are not supported on this platform");
+#else
+        backend = make_unique<RemoteShard>(address, shardTimeout);
+#endif
+      }
+      if (!router.addShard(lower, move(backend)))
+        return fail("Duplicate shard bound \"" + lower + "\"");
+    }
+    if (!dictPath.empty()) {
+      ifstream in(dictPath);
+      if (!in)
+        return fail("Cannot open dictionary file \"" + dictPath + "\"");
+      for (string line; getline(in, line);) {
+        uint32_t weight = splitWeight(line);
+        router.insert(line, weight);
+      }
+    }
+    CommandHandler handler(router);
+    return serveHeadless(handler);
+  }
+
+  Trie trie(keys);
+  MappedTrie snapshot;
+  trie.enableMetrics();
+  if (cacheEntries > 0)
+    trie.enableCache(cacheEntries);
+  if (!headless)
+    printBanner();
 
   // Preload Dictionary
   vector<string> dictionary = {
@@ -252,21 +1173,118 @@ int main() {
       "harbor",   "harmony",     "ice",    "igloo",   "island",    "iron",
       "imagine"};
 
-  cout << "  " << Color::BLUE << "Initializing system..." << Color::RESET
-       << "\n";
-  cout << "  " << Color::DIM
-       << "Loading dictionary and building trie structure..." << Color::RESET
-       << "\n\n";
+  if (!headless) {
+    cout << "  " << Color::BLUE << "Initializing system..." << Color::RESET
+         << "\n";
+    cout << "  " << Color::DIM
+         << "Loading dictionary and building trie structure..." << Color::RESET
+         << "\n\n";
+  }
 
   auto startLoad = high_resolution_clock::now();
-  for (const string &word : dictionary) {
-    trie.insert(word);
+  // A data directory that already holds data replaces the dictionary
+  bool fresh = true;
+#ifndef _WIN32
+  unique_ptr<TrieStore> store;
+  if (!dataDir.empty()) {
+    if (!snapshotPath.empty())
+      return fail("--data-dir cannot be combined with --snapshot");
+    store = make_unique<TrieStore>(trie, compactBytes);
+    string error;
+    if (!store->open(dataDir, fresh, error))
+      return fail(error);
+  }
+#else
+  if (!dataDir.empty())
+    return fail("--data-dir is not supported on this platform");
+#endif
+  if (!fresh) {
+#ifndef _WIN32
+    info("Recovered " + to_string(trie.getWordCount()) + " words from " +
+         dataDir + " (" + to_string(store->getReplayedRecords()) +
+         " log records replayed)");
+#endif
+  } else if (!snapshotPath.empty()) {
+    if (!snapshot.open(snapshotPath))
+      return fail("Cannot map snapshot file \"" + snapshotPath + "\"");
+    info("Serving read-only snapshot " + snapshotPath);
+  } else if (dictPath.empty()) {
+    for (const string &word : dictionary) {
+      trie.insert(word);
+    }
+  } else if (buildThreads > 1) {
+    ifstream in(dictPath);
+    if (!in)
+      return fail("Cannot open dictionary file \"" + dictPath + "\"");
+    vector<string> words;
+    vector<uint32_t> weights;
+    for (string line; getline(in, line);) {
+      weights.push_back(splitWeight(line));
+      words.push_back(move(line));
+    }
+    ThreadPool pool(buildThreads);
+    trie.buildParallel(words, pool, &weights);
+    info("Read " + to_string(words.size()) + " lines from " + dictPath +
+         " on " + to_string(buildThreads) + " threads");
+  } else {
+    LoadStats stats;
+    if (!trie.loadFromFile(dictPath, stats))
+      return fail("Cannot open dictionary file \"" + dictPath + "\"");
+    size_t resumed = stats.keyBytes ? 100 * stats.resumedBytes /
+                                          stats.keyBytes
+                                    : 0;
+    info("Read " + to_string(stats.lines) + " lines from " + dictPath +
+         " (" + (stats.sorted ? "sorted input, " : "") + to_string(resumed) +
+         "% of key bytes resumed from the previous line)");
   }
+#ifndef _WIN32
+  // Persist the seed dictionary so the next start recovers it; a store
+  // without it would serve only the logged deltas
+  if (store && fresh) {
+    string error;
+    if (!store->checkpoint(error))
+      return fail("Cannot snapshot the dictionary into " + dataDir + ": " +
+                  error);
+  }
+#endif
   auto endLoad = high_resolution_clock::now();
   auto loadDuration = duration_cast<microseconds>(endLoad - startLoad);
 
-  printSuccess("System ready! Loaded " + to_string(trie.getWordCount()) +
-               " words in " + to_string(loadDuration.count() / 1000.0) + "ms");
+  bool readOnly = snapshot.isOpen();
+  auto wordCount = [&]() {
+    return readOnly ? snapshot.getWordCount() : trie.getWordCount();
+  };
+
+  if (!headless)
+    printSuccess("System ready! Loaded " + to_string(wordCount()) +
+                 " words in " + to_string(loadDuration.count() / 1000.0) +
+                 "ms");
+
+  if (!saveSnapshotPath.empty()) {
+    // Queries seen in production, one per line, decide which nodes are hot
+    vector<string> hotQueries;
+    if (!profilePath.empty()) {
+      ifstream in(profilePath);
+      if (!in)
+        return fail("Cannot open profile file \"" + profilePath + "\"");
+      for (string line; getline(in, line);)
+        hotQueries.push_back(move(line));
+    }
+    if (readOnly || !trie.saveSnapshot(saveSnapshotPath, hotQueries))
+      return fail("Cannot write snapshot file \"" + saveSnapshotPath + "\"");
+    if (!headless)
+      printSuccess("Snapshot written to " + saveSnapshotPath);
+    return 0;
+  }
+
+  if (headless) {
+    CommandHandler handler = readOnly ? CommandHandler(snapshot)
+                                      : CommandHandler(trie);
+#ifndef _WIN32
+    handler.setStore(store.get());
+#endif
+    return serveHeadless(handler);
+  }
 
   // Main Loop
   while (true) {
@@ -289,33 +1307,69 @@ int main() {
       string prefix;
       getline(cin, prefix);
 
+      // Results are written as the traversal yields them, so memory stays
+      // flat even for "show all". The first row is flushed on its own so
+      // it appears at once; later rows go out in 64 KiB batches.
       auto start = high_resolution_clock::now();
-      vector<string> suggestions = trie.getSuggestions(prefix);
-      auto end = high_resolution_clock::now();
-      auto duration = duration_cast<microseconds>(end - start);
-
+      microseconds firstResult{0};
+      size_t found = 0;
       cout << "\n";
-      if (suggestions.empty()) {
+      {
+        BufferedWriter out(cout);
+        auto show = [&](const string &word) {
+          if (found++ == 0) {
+            printThickLine();
+            cout << "\n";
+          }
+          out << "    " << Color::DIM << "[" << (found < 10 ? " " : "")
+              << found << "]" << Color::RESET << "  " << Color::CYAN << word
+              << Color::RESET << "\n";
+          if (found == 1) {
+            out.flush();
+            firstResult =
+                duration_cast<microseconds>(high_resolution_clock::now() - start);
+          }
+          return true;
+        };
+        // A result cache stores whole pages, so it is consulted (and
+        // counted) through getSuggestions; only uncached reads stream
+        if (readOnly) {
+          snapshot.forEachSuggestion(prefix, show);
+        } else if (trie.hasCache()) {
+          for (const string &word : trie.getSuggestions(prefix))
+            show(word);
+        } else {
+          trie.forEachSuggestion(prefix, show);
+        }
+      }
+      auto duration =
+          duration_cast<microseconds>(high_resolution_clock::now() - start);
+
+      if (found == 0) {
         printError("No suggestions found for \"" + prefix + "\"");
-        cout << "  " << Color::DIM
-             << "Try a different prefix or check spelling." << Color::RESET
-             << "\n";
-      } else {
-        printThickLine();
-        cout << "\n  " << Color::BOLD << Color::GREEN << "✓ Found "
-             << suggestions.size() << " match"
-             << (suggestions.size() > 1 ? "es" : "") << Color::RESET
-             << Color::DIM << " (in " << duration.count() << "μs)"
-             << Color::RESET << "\n\n";
-        printLine();
-        cout << "\n";
-        int count = 1;
-        for (const string &word : suggestions) {
-          cout << "    " << Color::DIM << "[" << setw(2) << count++ << "]"
-               << Color::RESET << "  " << Color::CYAN << word << Color::RESET
+        vector<string> fuzzy;
+        if (!readOnly)
+          fuzzy = trie.getFuzzySuggestions(prefix, 1, 10);
+        if (fuzzy.empty()) {
+          cout << "  " << Color::DIM
+               << "Try a different prefix or check spelling." << Color::RESET
                << "\n";
+        } else {
+          cout << "\n  " << Color::YELLOW << "Did you mean:" << Color::RESET
+               << "\n\n";
+          for (const string &word : fuzzy) {
+            cout << "    " << Color::DIM << "~" << Color::RESET << "  "
+                 << Color::CYAN << word << Color::RESET << "\n";
+          }
         }
+      } else {
         cout << "\n";
+        printLine();
+        cout << "\n  " << Color::BOLD << Color::GREEN << "✓ Found " << found
+             << " match" << (found > 1 ? "es" : "") << Color::RESET
+             << Color::DIM << " (first in " << firstResult.count()
+             << "μs, all in " << duration.count() << "μs)" << Color::RESET
+             << "\n\n";
         printThickLine();
       }
       cout << "\n";
@@ -330,12 +1384,35 @@ int main() {
       cout << "\n";
       if (word.empty() || word.find_first_not_of(" \t\n\r") == string::npos) {
         printError("Cannot add empty word. Please try again.");
+      } else if (readOnly) {
+        printError("Dictionary is a read-only snapshot; words cannot be added.");
       } else {
         int oldCount = trie.getWordCount();
-        trie.insert(word);
+        bool logged = false, rejected = false;
+#ifndef _WIN32
+        if (store) {
+          logged = true;
+          rejected = !store->insert(word, 1);
+          if (rejected && !store->writable())
+            printError("Changes can no longer be recorded in " + dataDir +
+                       "; restart to recover.");
+          else if (rejected)
+            printError("Word is too long to record in " + dataDir + ".");
+          else if (!store->commit()) {
+            // The store has undone the insert
+            rejected = true;
+            printError("Could not write the change to " + dataDir +
+                       "; the word was not added.");
+          }
+        }
+#endif
+        if (!logged)
+          trie.insert(word);
         int newCount = trie.getWordCount();
 
-        if (newCount > oldCount) {
+        if (rejected) {
+          // Already reported; the dictionary is unchanged
+        } else if (newCount > oldCount) {
           printSuccess("Successfully added \"" + Color::BOLD + word +
                        Color::RESET + Color::GREEN + "\" to dictionary!");
           cout << "  " << Color::DIM << "Dictionary now contains " << newCount
@@ -354,15 +1431,56 @@ int main() {
            << Color::RESET << "\n\n";
       printLine();
       cout << "\n  " << Color::CYAN << "Total Words:        " << Color::RESET
-           << Color::BOLD << trie.getWordCount() << Color::RESET << "\n";
+           << Color::BOLD << wordCount() << Color::RESET << "\n";
       cout << "  " << Color::CYAN << "Data Structure:     " << Color::RESET
            << "Trie (Prefix Tree)\n";
       cout << "  " << Color::CYAN << "Search Algorithm:   " << Color::RESET
            << "Prefix Matching + DFS Traversal\n";
       cout << "  " << Color::CYAN << "Result Sorting:     " << Color::RESET
-           << "Alphabetical (std::sort)\n";
-      cout << "  " << Color::CYAN << "Performance:        " << Color::RESET
-           << "Sub-millisecond search times\n\n";
+           << "Alphabetical (ordered traversal)\n";
+      if (readOnly) {
+        cout << "  " << Color::CYAN << "Total Nodes:        " << Color::RESET
+             << snapshot.getNodeCount() << "\n";
+        cout << "  " << Color::CYAN << "Mapped Size:        " << Color::RESET
+             << formatBytes(snapshot.getMemoryUsage()) << "\n";
+      } else {
+        ShapeStats shape = trie.getShapeStats();
+        ostringstream fanout;
+        fanout << fixed << setprecision(2) << shape.averageFanout;
+        cout << "  " << Color::CYAN << "Total Nodes:        " << Color::RESET
+             << shape.nodes << "\n";
+        cout << "  " << Color::CYAN << "Memory:             " << Color::RESET
+             << formatBytes(shape.bytes) << "\n";
+        cout << "  " << Color::CYAN << "Max Depth:          " << Color::RESET
+             << shape.maxDepth << "\n";
+        cout << "  " << Color::CYAN << "Average Fan-out:    " << Color::RESET
+             << fanout.str() << "\n";
+        const TrieMetrics &metrics = *trie.getMetrics();
+        printLatencyLine("Searches:           ",
+                         metrics.latency[TrieMetrics::SUGGEST]);
+        printLatencyLine("Inserts:            ",
+                         metrics.latency[TrieMetrics::INSERT]);
+        const Log2Histogram &visited = metrics.nodesVisited;
+        if (visited.count() > 0)
+          cout << "  " << Color::CYAN << "Nodes per Search:   " << Color::RESET
+               << visited.sum() / visited.count() << " avg\n";
+      }
+      if (trie.hasCache()) {
+        CacheStats cacheStats = trie.getCacheStats();
+        uint64_t lookups = cacheStats.hits + cacheStats.misses;
+        ostringstream hitRate;
+        hitRate << fixed << setprecision(1)
+                << (lookups ? 100.0 * cacheStats.hits / lookups : 0.0);
+        cout << "  " << Color::CYAN << "Cache Hits:         " << Color::RESET
+             << cacheStats.hits << " / " << lookups << " lookups ("
+             << hitRate.str() << "%)\n";
+        cout << "  " << Color::CYAN << "Cache Misses:       " << Color::RESET
+             << cacheStats.misses << "\n";
+        cout << "  " << Color::CYAN << "Cache Entries:      " << Color::RESET
+             << cacheStats.entries << " (" << cacheStats.invalidations
+             << " invalidated)\n";
+      }
+      cout << "\n";
       printLine();
       cout << "\n  " << Color::DIM
            << "Tip: Press Enter at search prompt to view all words"
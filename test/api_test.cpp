@@ -0,0 +1,471 @@
+// Library-level checks for engine APIs the menu and line protocol do not
+// reach. Built and run by automated_test.sh; prints one line per failed
+// check and exits non-zero if any failed.
+#include "../src/trie.hpp"
+
+#include <iostream>
+#include <map>
+#include <random>
+
+using namespace std;
+using namespace autosuggest;
+
+int failures = 0;
+
+#define CHECK(condition)                                                      \
+  do {                                                                        \
+    if (!(condition)) {                                                       \
+      cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ")\n";     \
+      failures++;                                                             \
+    }                                                                         \
+  } while (0)
+
+/**
+ * Small alphabet, short keys: many shared stems, so prefixes at every
+ * depth have several matches. Deterministic for a given seed.
+ */
+vector<string> denseWords(size_t count, uint32_t seed) {
+  mt19937 rng(seed);
+  vector<string> words(count);
+  for (string &word : words) {
+    word.resize(1 + rng() % 6);
+    for (char &ch : word)
+      ch = static_cast<char>('a' + rng() % 3);
+  }
+  return words;
+}
+
+// ==================== SUGGEST SESSION ====================
+/**
+ * Every keystroke, backspace and page limit must give exactly what a
+ * fresh getSuggestions call gives, including after ADD/DEL change the
+ * trie underneath an open session
+ */
+void testSuggestSession() {
+  Trie trie;
+  for (const string &word : denseWords(400, 7))
+    trie.insert(word);
+
+  for (size_t limit : {Trie::NO_LIMIT, size_t(3), size_t(1), size_t(0)}) {
+    SuggestSession session(trie, limit);
+    auto matches = [&] {
+      return session.suggestions() ==
+             trie.getSuggestions(session.prefix(), limit);
+    };
+    CHECK(matches());
+    // Type down, back up and type a different branch; the longer prefixes
+    // are answered by narrowing the cached shorter ones
+    for (char ch : string("abcab")) {
+      session.push(ch);
+      CHECK(matches());
+    }
+    for (int i = 0; i < 3; i++) {
+      session.pop();
+      CHECK(matches());
+    }
+    for (char ch : string("Cba")) {
+      session.push(ch);
+      CHECK(matches());
+    }
+    CHECK(session.prefix() == "abcba");
+
+    // Writes bump the trie version, so the session re-descends
+    session.reset();
+    session.push('a');
+    session.push('b');
+    CHECK(matches());
+    trie.insert("abzzz");
+    CHECK(matches());
+    CHECK(limit < 2 ||
+          session.suggestions().back() == "abzzz" ||
+          session.suggestions().size() == limit);
+    session.push('z');
+    CHECK(matches());
+    CHECK(limit == 0 || session.suggestions().front() == "abzzz");
+    trie.remove("abzzz");
+    CHECK(matches());
+    CHECK(session.suggestions().empty());
+    session.pop();
+    CHECK(matches());
+
+    // Bytes the normalizer drops are skipped, as getSuggestions skips
+    // them, and pop() takes them back one keystroke at a time
+    session.reset();
+    string typed;
+    for (char ch : string("a-B' c")) {
+      session.push(ch);
+      typed.push_back(ch);
+      CHECK(session.suggestions() == trie.getSuggestions(typed, limit));
+    }
+    CHECK(session.prefix() == "abc");
+    while (!typed.empty()) {
+      session.pop();
+      typed.pop_back();
+      CHECK(session.suggestions() == trie.getSuggestions(typed, limit));
+    }
+    CHECK(session.prefix().empty());
+
+    // A prefix with no node stays empty as it grows
+    session.reset();
+    for (char ch : string("zq")) {
+      session.push(ch);
+      CHECK(matches());
+    }
+  }
+}
+
+// ==================== WORD ITERATOR ====================
+/**
+ * words(prefix) must yield exactly the getSuggestions(prefix) sequence:
+ * every stem, an empty range for a missing prefix, a key far deeper than
+ * the rest of the trie, and wide nodes with many children
+ */
+void testWordIterator() {
+  Trie trie;
+  for (const string &word : denseWords(400, 11))
+    trie.insert(word);
+  string deep(300, 'b');
+  deep += "end";
+  trie.insert(deep);
+  for (char ch = 'a'; ch <= 'z'; ch++)
+    trie.insert(string("wide") + ch);
+
+  auto collected = [&](string_view prefix) {
+    vector<string> words;
+    for (const Trie::WordEntry &entry : trie.words(prefix)) {
+      CHECK(entry.node.isEndOfWord);
+      words.push_back(entry.word);
+    }
+    return words;
+  };
+  for (string prefix : {"", "a", "ab", "cab", "B", "wide", "widez", "bbbb"})
+    CHECK(collected(prefix) == trie.getSuggestions(prefix));
+  CHECK(collected(deep) == vector<string>{deep});
+  string stem = deep.substr(0, 299);
+  CHECK(collected(stem) == trie.getSuggestions(stem));
+  CHECK(collected(deep + "x").empty());
+  CHECK(collected("zzz").empty());
+  CHECK(collected("").size() == static_cast<size_t>(trie.getWordCount()));
+
+  Trie empty;
+  CHECK(empty.words("").begin() == empty.words("").end());
+}
+
+// ==================== BULK LOAD ====================
+/**
+ * loadWords resumes each key from the previous key's node path and settles
+ * subtree bounds as nodes leave it. Sorted or shuffled, it must give the
+ * same trie as inserting one word at a time: same words, weights, subtree
+ * bounds and node layout
+ */
+void testLoadWords() {
+  mt19937 rng(13);
+  vector<pair<string, uint32_t>> entries;
+  for (const string &word : denseWords(2000, 17))
+    entries.push_back({word, static_cast<uint32_t>(rng() % 1000)});
+  sort(entries.begin(), entries.end());
+
+  size_t sortedResumed = 0;
+  for (bool shuffled : {false, true}) {
+    auto input = entries;
+    if (shuffled)
+      shuffle(input.begin(), input.end(), rng);
+    Trie loaded, inserted;
+    LoadStats stats = loaded.loadWords([&](auto &&emit) {
+      for (const auto &entry : input)
+        emit(entry.first, entry.second);
+    });
+    for (const auto &entry : input)
+      inserted.insert(entry.first, entry.second);
+    CHECK(stats.lines == input.size());
+    CHECK(stats.added == static_cast<size_t>(inserted.getWordCount()));
+    CHECK(stats.sorted == !shuffled);
+    CHECK(stats.resumedBytes <= stats.keyBytes);
+    if (shuffled)
+      CHECK(stats.resumedBytes < sortedResumed);
+    else
+      sortedResumed = stats.resumedBytes;
+    CHECK(loaded.serializeSnapshot() == inserted.serializeSnapshot());
+    for (string prefix : {"", "a", "cb", "abc"}) {
+      vector<Suggestion> got = loaded.getTopK(prefix, 7);
+      vector<Suggestion> want = inserted.getTopK(prefix, 7);
+      CHECK(got.size() == want.size());
+      for (size_t i = 0; i < min(got.size(), want.size()); i++)
+        CHECK(got[i].word == want[i].word && got[i].weight == want[i].weight);
+    }
+  }
+}
+
+// ==================== KEY NORMALIZATION ====================
+/**
+ * Normalizing a key again must leave it unchanged, so every stored key can
+ * be looked up by its own spelling. Random bytes mix spaces with bytes the
+ * table drops, which once shielded whitespace from the trim.
+ */
+void testNormalizeIdempotent() {
+  mt19937 rng(21);
+  const string pool = string("ab \t\r\n\x01\x7f\xc3\xa9") + '\0';
+  for (const KeyNormalizer &keys :
+       {KeyNormalizer::bytes(), KeyNormalizer::letters()}) {
+    for (int i = 0; i < 2000; i++) {
+      string raw(rng() % 8, ' ');
+      for (char &ch : raw)
+        ch = pool[rng() % pool.size()];
+      string key = keys.normalize(raw);
+      CHECK(keys.normalize(key) == key);
+    }
+  }
+
+  Trie trie(KeyNormalizer::bytes());
+  trie.insert("tea \x01");
+  CHECK(trie.getSuggestions("tea") == vector<string>{"tea"});
+  CHECK(trie.contains("tea") && trie.contains("\x01tea "));
+}
+
+// ==================== WEIGHT PARSING ====================
+/**
+ * Dictionary weights must never wrap: negative, non-numeric and partly
+ * numeric fields fall back to 1 and overlarge ones clamp to UINT32_MAX
+ */
+void testSplitWeight() {
+  auto parse = [](string line, const string &word) {
+    uint32_t weight = splitWeight(line);
+    CHECK(line == word);
+    return weight;
+  };
+  const uint32_t top = numeric_limits<uint32_t>::max();
+  CHECK(parse("word", "word") == 1);
+  CHECK(parse("word\t120", "word") == 120);
+  CHECK(parse("word\t 7\r", "word") == 7);
+  CHECK(parse("word\t0", "word") == 0);
+  CHECK(parse("word\t4294967295", "word") == top);
+  CHECK(parse("word\t-5", "word") == 1);
+  CHECK(parse("word\t99999999999", "word") == top);
+  CHECK(parse("word\t99999999999999999999999", "word") == top);
+  CHECK(parse("word\tabc", "word") == 1);
+  CHECK(parse("word\t12abc", "word") == 1);
+  CHECK(parse("word\t+3", "word") == 1);
+  CHECK(parse("word\t", "word") == 1);
+}
+
+// ==================== SUGGESTION CACHE ====================
+/**
+ * Bulk writes must not leave stale pages behind: a prefix cached before
+ * buildParallel or loadWords is answered with the new words afterwards
+ */
+void testCacheInvalidation() {
+  ThreadPool pool(2);
+  Trie trie;
+  trie.enableCache(100);
+  CHECK(trie.getSuggestions("a").empty());
+  trie.buildParallel({"apple", "apply", "banana"}, pool);
+  CHECK(trie.getSuggestions("a") == (vector<string>{"apple", "apply"}));
+
+  // A trie that already holds words takes the serial loadWords path
+  trie.buildParallel({"avocado"}, pool);
+  CHECK(trie.getSuggestions("a").size() == 3);
+  vector<string> more = {"apricot", "bean"};
+  trie.loadWords([&](auto &&emit) {
+    for (const string &word : more)
+      emit(word, 1);
+  });
+  CHECK(trie.getSuggestions("a") ==
+        (vector<string>{"apple", "apply", "apricot", "avocado"}));
+  CHECK(trie.getSuggestions("").size() == 6);
+
+  // A limit just short of NO_LIMIT must not wrap the end of the page,
+  // whether it is cut from a fresh window or from a cached entry
+  size_t huge = Trie::NO_LIMIT - 1;
+  CHECK(trie.getSuggestions("a", huge, 2).size() == 2);
+  CHECK(trie.getSuggestions("a", huge, 2).size() == 2);
+}
+
+// ==================== FIXED ALPHABETS ====================
+/**
+ * Random inserts and removes over input bytes, some not in the alphabet,
+ * checked against a std::map of normalized keys: contents, order, counts
+ * and top-K ranking must all agree
+ */
+template <typename Alphabet>
+void checkFixedAlphabet(const string &inputBytes, uint32_t seed) {
+  using Dense = FixedAlphabetTrie<Alphabet>;
+  Dense trie;
+  map<string, uint32_t> reference;
+  mt19937 rng(seed);
+  auto randomText = [&](size_t maxLength) {
+    string text(rng() % (maxLength + 1), ' ');
+    for (char &ch : text)
+      ch = inputBytes[rng() % inputBytes.size()];
+    return text;
+  };
+  for (int i = 0; i < 5000; i++) {
+    string word = randomText(6);
+    string key = Dense::normalize(word);
+    if (rng() % 3 == 0) {
+      bool present = reference.erase(key) > 0;
+      CHECK(trie.remove(word) == present);
+    } else {
+      uint32_t weight = rng() % 100;
+      trie.insert(word, weight);
+      if (!key.empty())
+        reference[key] = max(reference[key], weight);
+    }
+  }
+  CHECK(static_cast<size_t>(trie.getWordCount()) == reference.size());
+  vector<string> expected;
+  for (const auto &entry : reference) {
+    expected.push_back(entry.first);
+    CHECK(trie.contains(entry.first));
+  }
+  CHECK(trie.getSuggestions("") == expected);
+
+  for (int query = 0; query < 100; query++) {
+    string prefix = randomText(2);
+    string key = Dense::normalize(prefix);
+    vector<Suggestion> ranked;
+    for (const auto &entry : reference)
+      if (entry.first.compare(0, key.size(), key) == 0)
+        ranked.push_back({entry.first, entry.second});
+    sort(ranked.begin(), ranked.end(),
+         [](const Suggestion &a, const Suggestion &b) {
+           return a.weight != b.weight ? a.weight > b.weight : a.word < b.word;
+         });
+    ranked.resize(min<size_t>(ranked.size(), 5));
+    vector<Suggestion> top = trie.getTopK(prefix, 5);
+    CHECK(top.size() == ranked.size());
+    for (size_t i = 0; i < min(top.size(), ranked.size()); i++)
+      CHECK(top[i].word == ranked[i].word &&
+            top[i].weight == ranked[i].weight);
+  }
+}
+
+void testFixedAlphabets() {
+  checkFixedAlphabet<LowercaseAlphabet>("abcXYZ-", 1);
+  checkFixedAlphabet<DigitAlphabet>("0123 -+", 2);
+  checkFixedAlphabet<DnaAlphabet>("ACGTacgtN", 3);
+  checkFixedAlphabet<ByteAlphabet>(string("ab\0\xff Z", 6), 4);
+
+  FixedAlphabetTrie<DigitAlphabet> phones;
+  phones.insert("+1 (555) 123-4567", 3);
+  phones.insert("15551239999", 7);
+  CHECK(phones.contains("1-555-123-4567"));
+  CHECK(phones.getSuggestions("1 555 123") ==
+        (vector<string>{"15551234567", "15551239999"}));
+  CHECK(FixedAlphabetTrie<DnaAlphabet>::normalize("acgNT") == "ACGT");
+  CHECK(FixedAlphabetTrie<ByteAlphabet>::normalize(" A\n") == " A\n");
+}
+
+// ==================== MAPPED SNAPSHOTS ====================
+#ifndef _WIN32
+/**
+ * A valid snapshot maps; truncated or corrupted ones are rejected by
+ * open() rather than read out of bounds by later queries
+ */
+void testMappedSnapshotValidation() {
+  Trie trie;
+  for (const string &word : denseWords(300, 5))
+    trie.insert(word);
+  const string image = trie.serializeSnapshot();
+  string path = "/tmp/api_test_snapshot_" + to_string(getpid()) + ".bin";
+  auto opens = [&](const string &bytes) {
+    ofstream(path, ios::binary).write(bytes.data(),
+                                      static_cast<streamsize>(bytes.size()));
+    MappedTrie mapped;
+    return mapped.open(path);
+  };
+  SnapshotHeader header;
+  memcpy(&header, image.data(), sizeof(header));
+  auto withNode = [&](uint32_t id, auto &&edit) {
+    string bytes = image;
+    SnapshotNode node;
+    size_t at = header.nodesOffset + id * sizeof(SnapshotNode);
+    memcpy(&node, bytes.data() + at, sizeof(node));
+    edit(node);
+    memcpy(&bytes[at], &node, sizeof(node));
+    return bytes;
+  };
+
+  CHECK(opens(image));
+  CHECK(!opens(image.substr(0, image.size() - 1)));
+  CHECK(!opens(image + '\0'));
+  CHECK(!opens(image.substr(0, sizeof(SnapshotHeader) + 10)));
+  CHECK(!opens(withNode(0, [](SnapshotNode &node) {
+    node.firstChild = numeric_limits<uint32_t>::max() - 1;
+  })));
+  CHECK(!opens(withNode(0, [&](SnapshotNode &node) {
+    node.childCount = static_cast<uint16_t>(header.nodeCount);
+  })));
+  // A child range pointing back at the root would make walks loop
+  CHECK(!opens(withNode(1, [](SnapshotNode &node) {
+    node.firstChild = 0;
+    node.childCount = 1;
+  })));
+  CHECK(!opens(withNode(2, [](SnapshotNode &node) {
+    node.isEndOfWord = static_cast<uint8_t>(!node.isEndOfWord);
+  })));
+  string unsorted = image;
+  swap(unsorted[header.labelsOffset + 1], unsorted[header.labelsOffset + 2]);
+  CHECK(!opens(unsorted));
+  remove(path.c_str());
+}
+
+// ==================== TRIE STORE ====================
+/**
+ * Only writes that change the trie reach the log: re-adding a word at the
+ * same or a lower weight, a word that normalizes to nothing, or removing
+ * an absent word must not grow the segment
+ */
+void testStoreSkipsNoOps() {
+  string dir = "/tmp/api_test_store_" + to_string(getpid());
+  Trie trie;
+  TrieStore store(trie);
+  bool fresh = false;
+  string error;
+  CHECK(store.open(dir, fresh, error) && fresh);
+  auto logBytes = [&] {
+    CHECK(store.commit());
+    struct stat info;
+    string path = dir + "/wal-" + to_string(store.getSegment()) + ".log";
+    return stat(path.c_str(), &info) == 0 ? info.st_size : -1;
+  };
+  CHECK(store.insert("apple", 5));
+  off_t logged = logBytes();
+  CHECK(logged > 0);
+  CHECK(store.insert("apple", 5) && store.insert("APPLE ", 2));
+  CHECK(store.insert("?!", 1) && store.insert("", 1));
+  CHECK(!store.remove("pear"));
+  CHECK(logBytes() == logged);
+  CHECK(trie.getWordCount() == 1);
+
+  CHECK(store.insert("apple", 9));
+  CHECK(logBytes() > logged);
+  logged = logBytes();
+  CHECK(store.remove("Apple"));
+  CHECK(logBytes() > logged);
+  CHECK(trie.getWordCount() == 0 && !trie.contains("apple"));
+  // Far below the compaction threshold, so segment 0 is the only file
+  remove((dir + "/wal-0.log").c_str());
+  rmdir(dir.c_str());
+}
+#endif
+
+// ==================== MAIN FUNCTION ====================
+int main() {
+  testSuggestSession();
+  testWordIterator();
+  testLoadWords();
+  testNormalizeIdempotent();
+  testSplitWeight();
+  testCacheInvalidation();
+  testFixedAlphabets();
+#ifndef _WIN32
+  testMappedSnapshotValidation();
+  testStoreSkipsNoOps();
+#endif
+  if (failures > 0) {
+    cerr << failures << " check(s) failed\n";
+    return 1;
+  }
+  cout << "All API checks passed\n";
+  return 0;
+}
@@ -31,10 +31,11 @@ run_test() {
     local test_name="$1"
     local input="$2"
     local expected_pattern="$3"
+    shift 3
     
     echo -n "  Testing: $test_name... "
     
-    result=$(echo -e "$input" | ./trie_autosuggest 2>&1)
+    result=$(echo -e "$input" | ./trie_autosuggest "$@" 2>&1)
     
     if echo "$result" | grep -q "$expected_pattern"; then
         echo -e "${GREEN}✓ PASS${NC}"
@@ -49,7 +50,7 @@ run_test() {
 
 # Compile the program
 echo "Compiling..."
-g++ -std=c++17 -Wall -Wextra src/trie_autosuggest.cpp -o trie_autosuggest 2>&1
+g++ -std=c++17 -Wall -Wextra -pthread src/trie_autosuggest.cpp -o trie_autosuggest 2>&1
 
 if [ $? -ne 0 ]; then
     echo -e "${RED}✗ Compilation FAILED${NC}"
@@ -91,6 +92,193 @@ run_test "Alphabetical order check" "1\nap\n5" "apartment"
 # Test 10: Whitespace handling
 run_test "Whitespace trimming" "1\n  ap  \n5" "apartment"
 
+# Test 11: Fuzzy fallback for a misspelled prefix
+run_test "Fuzzy 'did you mean'" "1\ngirafe\n5" "giraffe"
+
+# Test 11b: Fuzzy matches need a real edit-distance hit, not an emptied prefix
+run_test "Fuzzy one-letter query" "FUZZY 1 10 z\nQUIT" "^OK 0$" --serve
+run_test "Fuzzy query within edits" "FUZZY 2 5 qq\nQUIT" "^OK 0$" --serve
+run_test "Fuzzy d=1 hit" "FUZZY 1 10 bsnana\nQUIT" "^banana$" --serve
+run_test "Fuzzy d=1 miss" "FUZZY 1 10 bsnsna\nQUIT" "^OK 0$" --serve
+run_test "Fuzzy d=2 hit" "FUZZY 2 10 bsnsna\nQUIT" "^banana$" --serve
+run_test "Fuzzy d=2 miss" "FUZZY 2 10 xyzzyq\nQUIT" "^OK 0$" --serve
+run_test "No fuzzy fallback for 'z'" "1\nz\n5" "Try a different prefix"
+
+# Test 12: Load dictionary from file
+DICT_FILE=$(mktemp)
+printf "zebra\nzenith\t5\nzero\n" > "$DICT_FILE"
+run_test "Load --dict file" "1\nze\n5" "zenith" --dict "$DICT_FILE"
+
+# Test 13: Result cache counters on the statistics screen
+run_test "Cache hit counter" "1\nap\n1\nap\n3\n5" "1 / 2 lookups" --cache 128
+
+# Test 14: Missing dictionary file
+run_test "Missing --dict file" "5" "Cannot open dictionary file" --dict /nonexistent/words.txt
+
+# Test 15: Parallel sharded build
+run_test "Parallel --threads build" "1\nzen\n5" "zenith" --dict "$DICT_FILE" --threads 4
+
+# Test 16: Snapshot round trip (write, then serve from mmap)
+SNAPSHOT_FILE=$(mktemp)
+./trie_autosuggest --dict "$DICT_FILE" --save-snapshot "$SNAPSHOT_FILE" > /dev/null 2>&1
+run_test "Search mapped snapshot" "1\nzer\n5" "zero" --snapshot "$SNAPSHOT_FILE"
+
+# Test 17: Snapshot is read-only
+run_test "Snapshot rejects add" "2\nzulu\n5" "read-only snapshot" --snapshot "$SNAPSHOT_FILE"
+
+# Test 18: Profile-guided snapshot layout serves the same words
+PROFILE_FILE=$(mktemp)
+printf "zen\nzer\nze\n" > "$PROFILE_FILE"
+./trie_autosuggest --dict "$DICT_FILE" --save-snapshot "$SNAPSHOT_FILE" --snapshot-profile "$PROFILE_FILE" > /dev/null 2>&1
+run_test "Profiled snapshot layout" "1\nzeb\n5" "zebra" --snapshot "$SNAPSHOT_FILE"
+rm -f "$DICT_FILE" "$SNAPSHOT_FILE" "$PROFILE_FILE"
+
+# Test 19: Byte keys keep punctuation and UTF-8
+BYTES_FILE=$(mktemp)
+printf "email\ne-mail\ncaf\xc3\xa9\n" > "$BYTES_FILE"
+run_test "Byte keys --keys bytes" "1\ne-\n5" "Found 1 match" --dict "$BYTES_FILE" --keys bytes
+rm -f "$BYTES_FILE"
+
+# Test 20: Headless line protocol on stdin/stdout
+run_test "Serve GET" "GET ap\nQUIT" "^OK 6$" --serve
+
+# Test 21: Pipelined writes are visible to later requests
+run_test "Serve ADD then GET" "ADD zulu\nGET zu\nQUIT" "^zulu$" --serve
+
+# Test 22: Statistics show measured structure, not fixed claims
+run_test "Statistics node count" "3\n5" "Total Nodes:"
+
+# Test 23: Prometheus exposition through the headless protocol
+run_test "Serve METRICS" "GET ap\nMETRICS\nQUIT" 'trie_operation_duration_nanoseconds_count{op="suggest"} 1' --serve
+
+# Test 24: Sharded router merges top-K across prefix-range shards
+SHARD_FILE=$(mktemp)
+printf "apple\t5\nmango\t9\nmelon\t2\n" > "$SHARD_FILE"
+run_test "Sharded router TOPK" "TOPK 2 \nQUIT" "^apple" --serve --dict "$SHARD_FILE" --shard =local --shard m=local
+rm -f "$SHARD_FILE"
+
+# Test 24b: A shard that accepts connections but never replies times out
+# and the router still answers from the shards that do
+SOCKET_DIR=$(mktemp -d)
+STALLED="$SOCKET_DIR/stalled.sock"
+python3 - "$STALLED" <<'PY' &
+import socket, sys, time
+server = socket.socket(socket.AF_UNIX)
+server.bind(sys.argv[1])
+server.listen(8)
+time.sleep(30)
+PY
+STALLER=$!
+for _ in $(seq 50); do
+    [ -S "$STALLED" ] && break
+    sleep 0.1
+done
+run_test "Stalled shard times out" "ADD mango\nGET \nQUIT" "^mango$" --serve --shard "=unix:$STALLED" --shard m=local --shard-timeout 200
+kill $STALLER 2> /dev/null
+wait $STALLER 2> /dev/null
+rm -rf "$SOCKET_DIR"
+
+# Test 25: Writes survive a restart through the data directory's log
+DATA_DIR=$(mktemp -d)
+printf "ADD zulu\nDEL apple\nQUIT\n" | ./trie_autosuggest --serve --data-dir "$DATA_DIR" > /dev/null 2>&1
+run_test "Data dir replays log" "GET zu\nQUIT" "^zulu$" --serve --data-dir "$DATA_DIR"
+rm -rf "$DATA_DIR"
+
+# Test 25b: A word too long for one log record is rejected, not truncated
+DATA_DIR=$(mktemp -d)
+LONG_WORD=$(head -c 1048577 /dev/zero | tr '\0' 'q')
+run_test "Oversized logged word rejected" "ADD $LONG_WORD\nQUIT" "^ERR word too long" --serve --data-dir "$DATA_DIR"
+run_test "Oversized word not replayed" "GET qqqq\nQUIT" "^OK 0$" --serve --data-dir "$DATA_DIR"
+rm -rf "$DATA_DIR"
+
+# Test 25c: Writes whose log commit fails are answered ERR, not OK, are
+# undone in memory, and later writes are refused. A file size limit makes
+# the log write fail.
+echo -n "  Testing: Failed log commit is not acknowledged... "
+DATA_DIR=$(mktemp -d)
+BIG_WORD=$(head -c 20000 /dev/zero | tr '\0' 'q')
+result=$( { printf 'ADD small\nADD %s\n' "$BIG_WORD"; sleep 0.3
+            printf 'ADD later\nGET small\nCOUNT\n'; } |
+          (trap '' XFSZ; ulimit -f 8
+           ./trie_autosuggest --serve --data-dir "$DATA_DIR") 2> /dev/null)
+rm -rf "$DATA_DIR"
+if [ "$(echo "$result" | grep -c '^ERR write-ahead log commit failed$')" = 2 ] &&
+   echo "$result" | grep -q '^ERR write-ahead log failed; writes are disabled$' &&
+   echo "$result" | grep -q '^OK 0$' &&
+   ! echo "$result" | grep -q '^OK 1$'; then
+    echo -e "${GREEN}✓ PASS${NC}"
+    ((PASSED++))
+else
+    echo -e "${RED}✗ FAIL${NC}"
+    echo "    Got: $result"
+    ((FAILED++))
+fi
+
+# Test 25d: Log segments left without a snapshot, as when the seed
+# snapshot never landed, are replayed over the seed dictionary, not
+# served in its place
+DATA_DIR=$(mktemp -d)
+printf "ADD zulu\nQUIT\n" | ./trie_autosuggest --serve --data-dir "$DATA_DIR" > /dev/null 2>&1
+rm -f "$DATA_DIR"/snapshot-*.bin
+run_test "Unseeded log keeps seed" "GET ap\nQUIT" "^apple$" --serve --data-dir "$DATA_DIR"
+run_test "Unseeded log replayed" "GET zu\nQUIT" "^zulu$" --serve --data-dir "$DATA_DIR"
+rm -rf "$DATA_DIR"
+
+# Test 26:A pipelining client that half-closes still gets every reply
+echo -n "  Testing: Half-closed socket client... "
+SOCKET_DIR=$(mktemp -d)
+SOCKET="$SOCKET_DIR/trie.sock"
+./trie_autosuggest --listen "unix:$SOCKET" > /dev/null 2>&1 &
+SERVER=$!
+for _ in $(seq 50); do
+    [ -S "$SOCKET" ] && break
+    sleep 0.1
+done
+if command -v nc > /dev/null; then
+    result=$(printf 'GET ap\nCOUNT\n' | nc -N -U "$SOCKET" 2>&1)
+else
+    result=$(python3 - "$SOCKET" <<'PY' 2>&1
+import socket, sys
+client = socket.socket(socket.AF_UNIX)
+client.connect(sys.argv[1])
+client.sendall(b"GET ap\nCOUNT\n")
+client.shutdown(socket.SHUT_WR)
+reply = b""
+while chunk := client.recv(4096):
+    reply += chunk
+sys.stdout.write(reply.decode())
+PY
+)
+fi
+kill $SERVER 2> /dev/null
+wait $SERVER 2> /dev/null
+rm -rf "$SOCKET_DIR"
+if echo "$result" | grep -q "^apple$" && echo "$result" | grep -q "^OK 49$"; then
+    echo -e "${GREEN}✓ PASS${NC}"
+    ((PASSED++))
+else
+    echo -e "${RED}✗ FAIL${NC}"
+    echo "    Got: $result"
+    ((FAILED++))
+fi
+
+# Test 27: Library-level API checks (test/api_test.cpp)
+echo -n "  Testing: Library API checks... "
+API_TEST=$(mktemp)
+if ! result=$(g++ -std=c++17 -Wall -Wextra -pthread test/api_test.cpp -o "$API_TEST" 2>&1); then
+    echo -e "${RED}✗ FAIL${NC}"
+    echo "    $result"
+    ((FAILED++))
+elif result=$("$API_TEST" 2>&1); then
+    echo -e "${GREEN}✓ PASS${NC}"
+    ((PASSED++))
+else
+    echo -e "${RED}✗ FAIL${NC}"
+    echo "$result" | sed 's/^/    /'
+    ((FAILED++))
+fi
+rm -f "$API_TEST"
+
 echo ""
 echo "━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━"
 echo ""
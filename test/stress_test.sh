@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# Stress Suite for the Trie engine
+# Builds bench/trie_stress.cpp and runs it against the library API: mixed
+# insert/query/remove traffic at 1-64 threads, churn leak checks and a
+# side-by-side backend comparison. Extra arguments go to the driver, e.g.
+#   test/stress_test.sh --words 1000000 --seconds 2
+# Set TSAN=1 to build with ThreadSanitizer instead of -O2.
+
+# Get the directory where the script is located
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_ROOT="$(dirname "$SCRIPT_DIR")"
+
+# Change to project root
+cd "$PROJECT_ROOT" || exit 1
+
+echo "╔════════════════════════════════════════════════════════╗"
+echo "║   TRIE AUTO-SUGGEST SYSTEM - STRESS SUITE              ║"
+echo "╚════════════════════════════════════════════════════════╝"
+echo ""
+
+# Colors for output
+RED='\033[0;31m'
+GREEN='\033[0;32m'
+NC='\033[0m' # No Color
+
+if [ "${TSAN:-0}" = "1" ]; then
+    FLAGS="-O1 -g -fsanitize=thread"
+else
+    FLAGS="-O2"
+fi
+
+BINARY=$(mktemp)
+trap 'rm -f "$BINARY"' EXIT
+echo "Building trie_stress ($FLAGS)..."
+if ! g++ -std=c++17 $FLAGS -pthread bench/trie_stress.cpp -o "$BINARY"; then
+    echo -e "${RED}✗ Build failed${NC}"
+    exit 1
+fi
+echo ""
+
+# Defaults keep a run to about ten seconds; later flags override
+"$BINARY" --words 200000 --seconds 0.5 --max-threads 64 "$@"
+STATUS=$?
+
+echo ""
+if [ $STATUS -eq 0 ]; then
+    echo -e "${GREEN}✓ Stress suite passed: no violations${NC}"
+    exit 0
+else
+    echo -e "${RED}✗ Stress suite failed (exit $STATUS): see \"violations\" above${NC}"
+    exit 1
+fi